@@ -0,0 +1,277 @@
+#include <pebble.h>
+#include <stdarg.h>
+#include "app_shim.h"
+#include "shim.h"
+
+#define MAX_TIMERS      16
+
+uint64_t g_sim_ms = 0;
+app_shim_stats g_app_shim_stats;
+
+struct AppTimer {
+  bool used;
+  uint64_t due;
+  AppTimerCallback callback;
+  void *data;
+};
+static AppTimer s_timers[MAX_TIMERS];
+
+static AppMessageInboxReceived s_inbox_received;
+static AppMessageOutboxSent s_outbox_sent;
+static AppMessageOutboxFailed s_outbox_failed;
+static MockVibeMotor s_motor;
+static MockPhoneLink s_phone_link;
+static MockPhoneDeliver s_phone_deliver;
+static uint32_t s_outbox_size;
+
+static DictionaryIterator s_outbox;
+static bool s_outbox_open = false;
+static bool s_in_flight = false;
+static uint64_t s_in_flight_due;
+static AppMessageResult s_in_flight_result;
+
+// Timers
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback,
+                             void *callback_data) {
+  g_app_shim_stats.timers_registered++;
+  for (int i = 0; i < MAX_TIMERS; i++) {
+    if (!s_timers[i].used) {
+      s_timers[i] = (AppTimer) {
+        .used = true,
+        .due = g_sim_ms + timeout_ms,
+        .callback = callback,
+        .data = callback_data,
+      };
+      return &s_timers[i];
+    }
+  }
+  return NULL;
+}
+
+void app_timer_cancel(AppTimer *timer_handle) {
+  if (timer_handle)
+    timer_handle->used = false;
+}
+
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms) {
+  if (timer_handle == NULL || !timer_handle->used)
+    return false;
+  timer_handle->due = g_sim_ms + new_timeout_ms;
+  return true;
+}
+
+// Vibes
+
+void vibes_enqueue_custom_pattern(VibePattern pattern) {
+  g_app_shim_stats.vibe_patterns++;
+  g_app_shim_stats.vibe_segments += pattern.num_segments;
+  if (s_motor)
+    s_motor(&pattern);
+}
+
+void vibes_cancel(void) {
+  if (s_motor)
+    s_motor(NULL);
+}
+
+// Wakeups and the worker. Wakeups are only counted; the worker is whatever
+// the host program linked in.
+
+WakeupId wakeup_schedule(time_t timestamp, int32_t cookie, bool notify_if_missed) {
+  g_app_shim_stats.wakeups_scheduled++;
+  g_app_shim_stats.last_wakeup = timestamp;
+  return (WakeupId)g_app_shim_stats.wakeups_scheduled;
+}
+
+void wakeup_cancel(WakeupId wakeup_id) {
+}
+
+void wakeup_cancel_all(void) {
+}
+
+bool app_worker_is_running(void) {
+  return true;
+}
+
+AppWorkerResult app_worker_launch(void) {
+  return APP_WORKER_RESULT_SUCCESS;
+}
+
+AppWorkerResult app_worker_kill(void) {
+  return APP_WORKER_RESULT_SUCCESS;
+}
+
+// Dictionaries
+
+static Tuple *dict_add(DictionaryIterator *iter, uint32_t key, TupleType type,
+                       uint16_t length) {
+  uint32_t size = (iter->size ? iter->size : 1) + 7 + length;
+  if (iter->count >= DICT_MAX_TUPLES || length > DICT_MAX_DATA ||
+      (iter->capacity && size > iter->capacity))
+    return NULL;
+  iter->size = size;
+  Tuple *t = &iter->tuples[iter->count++];
+  t->key = key;
+  t->type = type;
+  t->length = length;
+  return t;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key,
+                                 const uint8_t *data, const uint16_t size) {
+  Tuple *t = dict_add(iter, key, TUPLE_BYTE_ARRAY, size);
+  if (t == NULL)
+    return DICT_NOT_ENOUGH_STORAGE;
+  memcpy(t->value->data, data, size);
+  return DICT_OK;
+}
+
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key,
+                                    const char * const cstring) {
+  Tuple *t = dict_add(iter, key, TUPLE_CSTRING, strlen(cstring) + 1);
+  if (t == NULL)
+    return DICT_NOT_ENOUGH_STORAGE;
+  memcpy(t->value->cstring, cstring, strlen(cstring) + 1);
+  return DICT_OK;
+}
+
+#define DICT_WRITE_INT(name, ctype, tuple_type, field) \
+  DictionaryResult name(DictionaryIterator *iter, const uint32_t key, \
+                        const ctype value) { \
+    Tuple *t = dict_add(iter, key, tuple_type, sizeof(ctype)); \
+    if (t == NULL) \
+      return DICT_NOT_ENOUGH_STORAGE; \
+    memset(t->value, 0, sizeof(TupleValue)); \
+    t->value->field = value; \
+    return DICT_OK; \
+  }
+
+DICT_WRITE_INT(dict_write_uint8, uint8_t, TUPLE_UINT, uint8)
+DICT_WRITE_INT(dict_write_uint16, uint16_t, TUPLE_UINT, uint16)
+DICT_WRITE_INT(dict_write_uint32, uint32_t, TUPLE_UINT, uint32)
+DICT_WRITE_INT(dict_write_int32, int32_t, TUPLE_INT, int32)
+
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...) {
+  uint32_t size = 1 + 7 * tuple_count;
+  va_list args;
+  va_start(args, tuple_count);
+  for (uint8_t i = 0; i < tuple_count; i++)
+    size += va_arg(args, uint32_t);
+  va_end(args);
+  return size;
+}
+
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key) {
+  for (int i = 0; i < iter->count; i++) {
+    if (iter->tuples[i].key == key)
+      return (Tuple *)&iter->tuples[i];
+  }
+  return NULL;
+}
+
+// AppMessage
+
+AppMessageResult app_message_open(const uint32_t size_inbound,
+                                  const uint32_t size_outbound) {
+  s_outbox_size = size_outbound;
+  return APP_MSG_OK;
+}
+
+void app_message_deregister_callbacks(void) {
+  s_inbox_received = NULL;
+  s_outbox_sent = NULL;
+  s_outbox_failed = NULL;
+}
+
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback) {
+  AppMessageInboxReceived prev = s_inbox_received;
+  s_inbox_received = received_callback;
+  return prev;
+}
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback) {
+  AppMessageOutboxSent prev = s_outbox_sent;
+  s_outbox_sent = sent_callback;
+  return prev;
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback) {
+  AppMessageOutboxFailed prev = s_outbox_failed;
+  s_outbox_failed = failed_callback;
+  return prev;
+}
+
+uint32_t app_message_outbox_size_maximum(void) {
+  return 8200;
+}
+
+// Like the firmware, only one outgoing message may be pending at a time
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator) {
+  if (s_in_flight || s_outbox_open)
+    return APP_MSG_BUSY;
+  memset(&s_outbox, 0, sizeof(s_outbox));
+  s_outbox.size = 1;
+  s_outbox.capacity = s_outbox_size;
+  s_outbox_open = true;
+  *iterator = &s_outbox;
+  return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void) {
+  if (!s_outbox_open)
+    return APP_MSG_BUSY;
+  s_outbox_open = false;
+  if (s_outbox.size > s_outbox_size)
+    return APP_MSG_OUT_OF_MEMORY;
+  uint32_t latency = 0;
+  s_in_flight_result = s_phone_link ? s_phone_link(&s_outbox, &latency) : 
+                                 APP_MSG_NOT_CONNECTED;
+  s_in_flight_due = g_sim_ms + latency;
+  s_in_flight = true;
+  g_shim_stats.messages_sent++;
+  return APP_MSG_OK;
+}
+
+void app_shim_set_motor(MockVibeMotor motor) {
+  s_motor = motor;
+}
+
+void app_shim_set_phone(MockPhoneLink link, MockPhoneDeliver deliver) {
+  s_phone_link = link;
+  s_phone_deliver = deliver;
+}
+
+void app_shim_phone_send(const DictionaryIterator *message) {
+  if (s_inbox_received)
+    s_inbox_received((DictionaryIterator *)message, NULL);
+}
+
+// Run the next due event (message result or timer), advancing the clock.
+// Returns false once nothing is left to do.
+bool app_shim_step(void) {
+  AppTimer *next = NULL;
+  for (int i = 0; i < MAX_TIMERS; i++) {
+    if (s_timers[i].used && (next == NULL || s_timers[i].due < next->due))
+      next = &s_timers[i];
+  }
+  if (s_in_flight && (next == NULL || s_in_flight_due <= next->due)) {
+    g_sim_ms = s_in_flight_due;
+    s_in_flight = false;
+    if (s_in_flight_result == APP_MSG_OK) {
+      if (s_phone_deliver)
+        s_phone_deliver(&s_outbox);
+      if (s_outbox_sent)
+        s_outbox_sent(&s_outbox, NULL);
+    } else if (s_outbox_failed) {
+      s_outbox_failed(&s_outbox, s_in_flight_result, NULL);
+    }
+    return true;
+  }
+  if (next == NULL)
+    return false;
+  g_sim_ms = next->due;
+  next->used = false;
+  next->callback(next->data);
+  return true;
+}
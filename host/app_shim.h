@@ -0,0 +1,30 @@
+#pragma once
+#include <pebble.h>
+
+// Simulated clock for the app-side fakes, in milliseconds
+extern uint64_t g_sim_ms;
+
+typedef struct app_shim_stats {
+  uint64_t wakeups_scheduled;
+  time_t last_wakeup;      // when the newest wakeup was set for
+  uint64_t timers_registered;
+  uint64_t vibe_patterns;
+  uint64_t vibe_segments;
+} app_shim_stats;
+
+extern app_shim_stats g_app_shim_stats;
+
+// The far end of AppMessage. The link decides when a message will be
+// acknowledged (or fail); acknowledged messages are delivered at that time.
+typedef AppMessageResult (*MockPhoneLink)(const DictionaryIterator *message,
+                                          uint32_t *latency_ms);
+typedef void (*MockPhoneDeliver)(const DictionaryIterator *message);
+
+// Called for every vibe pattern handed to the firmware, and with NULL when
+// the vibes are cancelled
+typedef void (*MockVibeMotor)(const VibePattern *pattern);
+
+void app_shim_set_motor(MockVibeMotor motor);
+void app_shim_set_phone(MockPhoneLink link, MockPhoneDeliver deliver);
+void app_shim_phone_send(const DictionaryIterator *message);
+bool app_shim_step(void);
@@ -0,0 +1,153 @@
+// Checks both zero-crossing kernels against a reference that removes
+// gravity with a square root, as the worker once did, on random, boundary
+// and wrist-like batches, then times them on the wrist-like ones. The
+// worker's actual float code (reference.c) isn't exact enough to check
+// against, so the batches where it differs are counted instead.
+
+#include <pebble_worker.h>
+#include <math.h>
+#include "shim.h"
+#include "kernel.h"
+#include "reference.h"
+
+#define BATCH       25    // SAMPLES_PER_BATCH in accel.c
+#define CHECKS      200000
+#define ROUNDS      200000
+
+static volatile uint32_t s_sink;
+
+static uint32_t s_seed = 1;
+static uint32_t next_rand(void) {
+  s_seed = s_seed * 1103515245 + 12345;
+  return s_seed >> 1;
+}
+
+static int16_t around(int16_t v, int16_t spread) {
+  return v + (int16_t)(next_rand() % (2 * spread + 1)) - spread;
+}
+
+// Any int16 on every axis
+static void fill_random(AccelData *batch) {
+  for (int i = 0; i < BATCH; i++) {
+    batch[i].x = (int16_t)next_rand();
+    batch[i].y = (int16_t)next_rand();
+    batch[i].z = (int16_t)next_rand();
+    batch[i].did_vibrate = next_rand() % 16 == 0;
+  }
+}
+
+// Magnitudes right around 1 g, where the residual rounds to zero or not
+static void fill_boundary(AccelData *batch) {
+  static const int16_t axes[][3] = {
+    {0, 0, 1000}, {0, 0, -1000}, {600, 800, 0}, {577, 577, 577},
+    {1, 0, 1000}, {0, 1, 999}, {2, 0, 1001}, {-1, -1, -1000},
+  };
+  for (int i = 0; i < BATCH; i++) {
+    const int16_t *a = axes[next_rand() % (sizeof(axes) / sizeof(axes[0]))];
+    batch[i].x = around(a[0], 3);
+    batch[i].y = around(a[1], 3);
+    batch[i].z = around(a[2], 3);
+    batch[i].did_vibrate = next_rand() % 32 == 0;
+  }
+}
+
+// A resting wrist with a little tremor, occasionally turning over
+static void fill_wrist(AccelData *batch) {
+  int16_t z = next_rand() % 8 == 0 ? 1000 : -1000;
+  for (int i = 0; i < BATCH; i++) {
+    batch[i].x = around(40, 30);
+    batch[i].y = around(-20, 30);
+    batch[i].z = around(z, 30);
+    batch[i].did_vibrate = false;
+  }
+}
+
+// Sign of one axis with gravity removed, v - 1000*v/|a| truncated to
+// whole mg, the way the float code had it. The residual is worked out as
+// v*(|a|-1000)/|a| in long double: exact when |a| is a whole number, and
+// otherwise far enough from 1 mg that the rounding can't matter.
+static int reference_sign(int16_t v, long double magnitude) {
+  long double residual = v * (magnitude - 1000) / magnitude;
+  if (fabsl(residual) < 1)
+    return 0;
+  return residual < 0 ? -1 : 1;
+}
+
+static uint16_t kernel_count_reference(const AccelData *data, uint32_t num_samples,
+                                       uint16_t *counted) {
+  uint16_t count = 0;
+  int sx_prev = 0, sy_prev = 0, sz_prev = 0;
+  for (uint32_t i = 0; i < num_samples; i++) {
+    const AccelData *d = &data[i];
+    if (d->did_vibrate)
+      continue;
+    (*counted)++;
+    long double magnitude = sqrtl((long double)d->x * d->x + (long double)d->y * d->y +
+                                  (long double)d->z * d->z);
+    int sx = reference_sign(d->x, magnitude);
+    int sy = reference_sign(d->y, magnitude);
+    int sz = reference_sign(d->z, magnitude);
+    if (sx * sx_prev < 0 || sy * sy_prev < 0 || sz * sz_prev < 0)
+      count++;
+    sx_prev = sx;
+    sy_prev = sy;
+    sz_prev = sz;
+  }
+  return count;
+}
+
+static bool check(void (*fill)(AccelData *), const char *name) {
+  AccelData batch[BATCH];
+  memset(batch, 0, sizeof(batch));
+  uint32_t float_batches = 0, float_crossings = 0;
+  for (uint32_t r = 0; r < CHECKS; r++) {
+    fill(batch);
+    uint16_t counted_reference = 0, counted_portable = 0, counted_dsp = 0;
+    uint16_t counted_float = 0;
+    uint16_t reference = kernel_count_reference(batch, BATCH, &counted_reference);
+    uint16_t portable = kernel_count_portable(batch, BATCH, &counted_portable);
+    uint16_t dsp = kernel_count_dsp(batch, BATCH, &counted_dsp);
+    uint16_t old = reference_count_float(batch, BATCH, &counted_float);
+    if (portable != reference || dsp != reference ||
+        counted_portable != counted_reference || counted_dsp != counted_reference) {
+      printf("%-10s MISMATCH in batch %u: %u/%u/%u crossings, %u/%u/%u samples "
+             "(reference/portable/dsp)\n", name, (unsigned int)r,
+             reference, portable, dsp, counted_reference, counted_portable, counted_dsp);
+      return false;
+    }
+    if (old != portable) {
+      float_batches++;
+      float_crossings += old > portable ? old - portable : portable - old;
+    }
+  }
+  printf("%-10s ok (%u batches), float differs in %u by %u crossings\n", name,
+         CHECKS, (unsigned int)float_batches, (unsigned int)float_crossings);
+  return true;
+}
+
+static double bench(uint16_t (*kernel)(const AccelData *, uint32_t, uint16_t *),
+                    AccelData *batches) {
+  uint64_t start = shim_nanos();
+  uint32_t sum = 0;
+  for (uint32_t r = 0; r < ROUNDS; r++) {
+    uint16_t counted = 0;
+    sum += kernel(&batches[(r % 64) * BATCH], BATCH, &counted);
+  }
+  s_sink = sum;
+  return (double)(shim_nanos() - start) / ROUNDS;
+}
+
+int main(void) {
+  bool ok = check(fill_random, "random") &
+            check(fill_boundary, "boundary") &
+            check(fill_wrist, "wrist");
+
+  static AccelData batches[64 * BATCH];
+  for (int b = 0; b < 64; b++)
+    fill_wrist(&batches[b * BATCH]);
+  printf("%u-sample batch, ns/batch\n", BATCH);
+  printf("portable   %.1f\n", bench(kernel_count_portable, batches));
+  printf("dsp        %.1f\n", bench(kernel_count_dsp, batches));
+  printf("kernels    %s\n", ok ? "ok" : "MISMATCH");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+// Checks the byte-wide epoch_ring against a plain record of everything
+// pushed, across wraparound and resizes, and the detectors' running window
+// sums against sums worked out from the whole ring. Then micro-benchmarks
+// the ring against the generic circular_buffer on the worker's access
+// patterns: push one epoch, then sum the window.
+
+#include <pebble_worker.h>
+#include "shim.h"
+#include "arena.h"
+#include "datastore.h"
+#include "detector.h"
+#include "params.h"
+
+#define WINDOW      120
+#define ROUNDS      200000
+#define FUZZ_RINGS  2000
+#define FUZZ_PUSHES 2000
+#define SUM_NIGHTS  200
+#define SUM_EPOCHS  1000
+
+static volatile uint32_t s_sink;
+
+static uint32_t s_seed = 1;
+static uint32_t next_rand(void) {
+  s_seed = s_seed * 1103515245 + 12345;
+  return s_seed >> 1;
+}
+
+// The newest n items of the ring, by er_peek and by er_spans, against the
+// record, where they are the last count pushed
+static bool ring_matches(const epoch_ring *er, const uint8_t *pushed, size_t num_pushed,
+                         size_t count, size_t n) {
+  if (er_size(er) != count)
+    return false;
+  for (size_t i = 0; i < count; i++) {
+    if (er_peek(er, i) != pushed[num_pushed - 1 - i])
+      return false;
+  }
+  epoch_span spans[2];
+  size_t k = er_spans(er, n, spans);
+  size_t expect = n < count ? n : count;
+  size_t from = num_pushed - expect;
+  if (k > 2 || (expect == 0) != (k == 0))
+    return false;
+  for (size_t s = 0; s < k; s++) {
+    if (spans[s].len == 0 || memcmp(spans[s].data, &pushed[from], spans[s].len) != 0)
+      return false;
+    from += spans[s].len;
+  }
+  return from == num_pushed;
+}
+
+// Random capacities and pushes, with the window now and then resized
+// within the ring's storage as new settings do
+static bool fuzz_ring(void) {
+  static uint8_t pushed[FUZZ_PUSHES];
+  for (uint32_t r = 0; r < FUZZ_RINGS; r++) {
+    epoch_ring er;
+    size_t capacity = 1 + next_rand() % EPOCHS_IN_BUFFER;
+    er_init(&er, capacity);
+    size_t storage = (size_t)er.mask + 1;
+    size_t count = 0;
+    size_t num_pushes = next_rand() % FUZZ_PUSHES;
+    for (size_t p = 0; p < num_pushes; p++) {
+      if (next_rand() % 64 == 0) {
+        capacity = next_rand() % (storage + 8);
+        er_resize(&er, capacity);
+        if (capacity > storage)
+          capacity = storage;
+        if (count > capacity)
+          count = capacity;
+      }
+      pushed[p] = (uint8_t)next_rand();
+      er_push_back(&er, pushed[p]);
+      if (count < capacity)
+        count++;
+      if (!ring_matches(&er, pushed, p + 1, count, next_rand() % (storage + 8))) {
+        printf("er fuzz          MISMATCH in ring %u, push %u (capacity %u, %u items)\n",
+               (unsigned int)r, (unsigned int)p, (unsigned int)capacity,
+               (unsigned int)count);
+        er_free(&er);
+        return false;
+      }
+    }
+    er_free(&er);
+  }
+  printf("er fuzz          ok (%u rings)\n", FUZZ_RINGS);
+  return true;
+}
+
+// Sum of the epochs from age from up to, not including, age to
+static uint32_t ring_sum(const epoch_ring *er, size_t from, size_t to) {
+  uint32_t sum = 0;
+  for (size_t i = from; i < to && i < er_size(er); i++)
+    sum += er_peek(er, i);
+  return sum;
+}
+
+// What the bins detector makes of the ring, summing it from scratch the
+// way is_local_max once did
+static bool sums_match(const epoch_ring *er) {
+  size_t n = er_size(er);
+  uint16_t bin = g_params.bin_minutes;
+  uint16_t mean = n ? ring_sum(er, 0, n) / n : 0;
+  uint16_t level = mean * bin;
+  uint32_t bins[3];
+  for (int b = 0; b < 3; b++)
+    bins[b] = ring_sum(er, b * bin, (b + 1) * bin);
+  uint64_t percent = level ? (uint64_t)bins[1] * 100 / level : 0;
+  uint16_t score = percent > UINT16_MAX ? UINT16_MAX : percent;
+  bool peak = n >= er->capacity && er->capacity / bin >= 3 &&
+              bins[1] > level && bins[0] <= bins[1] && bins[1] >= bins[2];
+  return detector_mean(er) == mean && detector_score(er) == score &&
+         detector_is_peak(er) == peak;
+}
+
+// Random nights through the bins detector, each with its own window and
+// bin length, some restless and some calm, and new settings now and then
+// resizing the window and rebuilding the detector as accel.c does
+static bool check_sums(void) {
+  uint32_t peaks = 0;
+  for (uint32_t night = 0; night < SUM_NIGHTS; night++) {
+    g_params.bin_minutes = 1 + next_rand() % 20;
+    size_t least = 3 * g_params.bin_minutes;
+    epoch_ring er;
+    er_init(&er, least + next_rand() % (EPOCHS_IN_BUFFER - least + 1));
+    detector_init(DETECTOR_BINS);
+    uint8_t spread = night % 2 ? 255 : 16;
+    for (uint32_t e = 0; e < SUM_EPOCHS; e++) {
+      if (next_rand() % 200 == 0) {
+        er_resize(&er, least + next_rand() % (er.mask + 1 - least + 1));
+        detector_rebuild(&er);
+      }
+      uint8_t epoch = (uint8_t)(next_rand() % spread + (e / 30 % 2) * (255 - spread));
+      detector_push(&er, epoch);
+      er_push_back(&er, epoch);
+      if (!sums_match(&er)) {
+        printf("window sums      MISMATCH in night %u, epoch %u\n",
+               (unsigned int)night, (unsigned int)e);
+        er_free(&er);
+        return false;
+      }
+      peaks += detector_is_peak(&er);
+    }
+    er_free(&er);
+  }
+  printf("window sums      ok (%u nights, %u peaks)\n", SUM_NIGHTS, (unsigned int)peaks);
+  return true;
+}
+
+static double bench_cb(void) {
+  circular_buffer cb;
+  cb_init(&cb, WINDOW, sizeof(uint8_t));
+  uint64_t start = shim_nanos();
+  for (uint32_t r = 0; r < ROUNDS; r++) {
+    uint8_t v = (uint8_t)r;
+    cb_push_back(&cb, &v);
+    uint32_t sum = 0;
+    size_t n = cb_size(&cb);
+    for (size_t i = 0; i < n; i++)
+      sum += *(uint8_t*)cb_peek(&cb, i);
+    s_sink = sum;
+  }
+  double ns = (double)(shim_nanos() - start) / ROUNDS;
+  cb_free(&cb);
+  return ns;
+}
+
+static double bench_er_peek(void) {
+  epoch_ring er;
+  er_init(&er, WINDOW);
+  uint64_t start = shim_nanos();
+  for (uint32_t r = 0; r < ROUNDS; r++) {
+    er_push_back(&er, (uint8_t)r);
+    uint32_t sum = 0;
+    size_t n = er_size(&er);
+    for (size_t i = 0; i < n; i++)
+      sum += er_peek(&er, i);
+    s_sink = sum;
+  }
+  double ns = (double)(shim_nanos() - start) / ROUNDS;
+  er_free(&er);
+  return ns;
+}
+
+static double bench_er_spans(void) {
+  epoch_ring er;
+  er_init(&er, WINDOW);
+  uint64_t start = shim_nanos();
+  for (uint32_t r = 0; r < ROUNDS; r++) {
+    er_push_back(&er, (uint8_t)r);
+    uint32_t sum = 0;
+    epoch_span spans[2];
+    size_t k = er_spans(&er, WINDOW, spans);
+    for (size_t s = 0; s < k; s++)
+      for (size_t i = 0; i < spans[s].len; i++)
+        sum += spans[s].data[i];
+    s_sink = sum;
+  }
+  double ns = (double)(shim_nanos() - start) / ROUNDS;
+  er_free(&er);
+  return ns;
+}
+
+int main(void) {
+  params_load();
+  bool ok = fuzz_ring() & check_sums();
+  printf("push + %u-epoch sum, ns/round\n", WINDOW);
+  printf("cb_peek          %.1f\n", bench_cb());
+  printf("er_peek          %.1f\n", bench_er_peek());
+  printf("er_spans         %.1f\n", bench_er_spans());
+  printf("ring             %s\n", ok ? "ok" : "MISMATCH");
+  return ok ? 0 : 1;
+}
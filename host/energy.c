@@ -0,0 +1,298 @@
+// The shims count the events that cost battery, charging flash, messages
+// and launches to the source file that asked for them; this prices those
+// counts and adds them up by subsystem, each named for the file that
+// drives it.
+
+#include <pebble.h>
+#include "energy.h"
+#include "app_shim.h"
+#include "shim.h"
+
+#define MAX_INTERVALS     512
+#define UAS_PER_MAH       3.6e6
+
+typedef enum {
+  COST_ACCEL_10HZ,
+  COST_ACCEL_25HZ,
+  COST_ACCEL_50HZ,
+  COST_ACCEL_100HZ,
+  COST_ACCEL_CALLBACK,
+  COST_ACCEL_SAMPLE,
+  COST_TICK,
+  COST_PERSIST_READ,
+  COST_PERSIST_WRITE,
+  COST_PERSIST_BYTE,
+  COST_MESSAGE,
+  COST_VIBE,
+  COST_LAUNCH,
+  COST_APP_TIMER,
+  COSTS,
+} Cost;
+
+static const char *s_cost_names[COSTS] = {
+  [COST_ACCEL_10HZ] = "accel_ua_10hz",
+  [COST_ACCEL_25HZ] = "accel_ua_25hz",
+  [COST_ACCEL_50HZ] = "accel_ua_50hz",
+  [COST_ACCEL_100HZ] = "accel_ua_100hz",
+  [COST_ACCEL_CALLBACK] = "accel_callback_uas",
+  [COST_ACCEL_SAMPLE] = "accel_sample_uas",
+  [COST_TICK] = "tick_uas",
+  [COST_PERSIST_READ] = "persist_read_uas",
+  [COST_PERSIST_WRITE] = "persist_write_uas",
+  [COST_PERSIST_BYTE] = "persist_byte_uas",
+  [COST_MESSAGE] = "message_uas",
+  [COST_VIBE] = "vibe_ua",
+  [COST_LAUNCH] = "launch_uas",
+  [COST_APP_TIMER] = "app_timer_uas",
+};
+
+static double s_costs[COSTS];
+static const char *s_table;
+
+typedef enum {
+  SUBSYSTEM_ACCEL,
+  SUBSYSTEM_BACKGROUND,
+  SUBSYSTEM_ALARM,
+  SUBSYSTEM_SETTINGS,
+  SUBSYSTEM_OTHER,
+  SUBSYSTEMS,
+} Subsystem;
+
+static const char *s_subsystem_names[SUBSYSTEMS] = {
+  "accel.c", "background.c", "alarm.c", "settings.c", "other"
+};
+
+// Files charged to each subsystem: the recording pipeline under accel.c,
+// the scheduling around it under background.c, and on the app side the
+// alarm's vibes and latency under alarm.c and the stored alarms and
+// parameters under settings.c
+static const struct {
+  const char *file;
+  Subsystem subsystem;
+} s_files[] = {
+  { "worker_src/c/accel.c", SUBSYSTEM_ACCEL },
+  { "worker_src/c/arena.c", SUBSYSTEM_ACCEL },
+  { "worker_src/c/backfill.c", SUBSYSTEM_ACCEL },
+  { "worker_src/c/baseline.c", SUBSYSTEM_ACCEL },
+  { "worker_src/c/cycle.c", SUBSYSTEM_ACCEL },
+  { "worker_src/c/datastore.c", SUBSYSTEM_ACCEL },
+  { "worker_src/c/detector.c", SUBSYSTEM_ACCEL },
+  { "worker_src/c/history.c", SUBSYSTEM_ACCEL },
+  { "worker_src/c/stats.c", SUBSYSTEM_ACCEL },
+  { "worker_src/c/background.c", SUBSYSTEM_BACKGROUND },
+  { "worker_src/c/params.c", SUBSYSTEM_BACKGROUND },
+  { "worker_src/c/protocol.c", SUBSYSTEM_BACKGROUND },
+  { "worker_src/c/schedule.c", SUBSYSTEM_BACKGROUND },
+  { "src/c/alarm.c", SUBSYSTEM_ALARM },
+  { "src/c/latency.c", SUBSYSTEM_ALARM },
+  { "src/c/main.c", SUBSYSTEM_ALARM },
+  { "src/c/sequence.c", SUBSYSTEM_ALARM },
+  { "src/c/params.c", SUBSYSTEM_SETTINGS },
+  { "src/c/protocol.c", SUBSYSTEM_SETTINGS },
+  { "src/c/settings.c", SUBSYSTEM_SETTINGS },
+};
+
+// Where the charge goes, so it can be shown by kind as well
+typedef enum {
+  KIND_SENSOR,
+  KIND_CPU,
+  KIND_FLASH,
+  KIND_MESSAGES,
+  KIND_VIBE,
+  KIND_LAUNCHES,
+  KINDS,
+} Kind;
+
+static const char *s_kind_names[KINDS] = {
+  "sensor", "cpu", "flash", "msgs", "vibe", "launch"
+};
+
+typedef struct energy_sheet {
+  double uas[SUBSYSTEMS][KINDS];
+} energy_sheet;
+
+// Read a table of "name value" lines. Every cost has to be there, so a
+// table can't silently leave one at zero.
+bool energy_load(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+  bool seen[COSTS] = {false};
+  char line[128];
+  int line_number = 0;
+  bool ok = true;
+  while (fgets(line, sizeof(line), f)) {
+    line_number++;
+    char name[64];
+    double value;
+    if (line[0] == '#' || sscanf(line, "%63s", name) != 1)
+      continue;
+    if (sscanf(line, "%63s %lf", name, &value) != 2) {
+      fprintf(stderr, "%s:%d: expected a name and a value\n", path, line_number);
+      ok = false;
+      continue;
+    }
+    int cost = -1;
+    for (int i = 0; i < COSTS; i++) {
+      if (strcmp(name, s_cost_names[i]) == 0)
+        cost = i;
+    }
+    if (cost < 0) {
+      fprintf(stderr, "%s:%d: unknown cost %s\n", path, line_number, name);
+      ok = false;
+      continue;
+    }
+    s_costs[cost] = value;
+    seen[cost] = true;
+  }
+  fclose(f);
+  for (int i = 0; i < COSTS; i++) {
+    if (!seen[i]) {
+      fprintf(stderr, "%s: no value for %s\n", path, s_cost_names[i]);
+      ok = false;
+    }
+  }
+  s_table = path;
+  return ok;
+}
+
+// The firmware's vibe queue, as the sequence bench has it: a pattern
+// starts once the one before it is done, and cancelling drops whatever
+// has not played yet. Only the motor's on time is kept.
+static struct {
+  uint64_t start;
+  uint64_t end;
+} s_intervals[MAX_INTERVALS];
+static uint32_t s_num_intervals;
+static uint64_t s_busy_until;
+static uint64_t s_vibe_ms;
+
+void energy_motor(const VibePattern *pattern) {
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < s_num_intervals; i++) {
+    if (s_intervals[i].end > g_sim_ms)
+      s_intervals[kept++] = s_intervals[i];
+  }
+  s_num_intervals = kept;
+
+  if (pattern == NULL) {
+    for (uint32_t i = 0; i < s_num_intervals; i++) {
+      uint64_t from = s_intervals[i].start > g_sim_ms ? s_intervals[i].start : g_sim_ms;
+      s_vibe_ms -= s_intervals[i].end - from;
+    }
+    s_num_intervals = 0;
+    s_busy_until = g_sim_ms;
+    return;
+  }
+  uint64_t t = s_busy_until > g_sim_ms ? s_busy_until : g_sim_ms;
+  for (uint32_t i = 0; i < pattern->num_segments; i++) {
+    uint32_t ms = pattern->durations[i];
+    if (i % 2 == 0 && ms > 0) {
+      s_vibe_ms += ms;
+      if (s_num_intervals < MAX_INTERVALS) {
+        s_intervals[s_num_intervals].start = t;
+        s_intervals[s_num_intervals].end = t + ms;
+        s_num_intervals++;
+      }
+    }
+    t += ms;
+  }
+  s_busy_until = t;
+}
+
+uint64_t energy_vibe_ms(void) {
+  return s_vibe_ms;
+}
+
+static Subsystem subsystem_of(const char *file) {
+  size_t n = strlen(file);
+  for (size_t i = 0; i < ARRAY_LENGTH(s_files); i++) {
+    size_t m = strlen(s_files[i].file);
+    if (n >= m && strcmp(file + n - m, s_files[i].file) == 0)
+      return s_files[i].subsystem;
+  }
+  return SUBSYSTEM_OTHER;
+}
+
+// Charge everything counted so far. The accelerometer, its batches and
+// the ticks belong to their only subscriber; flash, messages and launches
+// to the file that made the call; the motor and app timers to the alarm.
+static void fill_sheet(const energy_app *app, energy_sheet *sheet) {
+  const shim_stats *st = &g_shim_stats;
+  memset(sheet, 0, sizeof(*sheet));
+  for (int r = 0; r < SHIM_RATES; r++)
+    sheet->uas[SUBSYSTEM_ACCEL][KIND_SENSOR] +=
+      st->rate_seconds[r] * s_costs[COST_ACCEL_10HZ + r];
+  sheet->uas[SUBSYSTEM_ACCEL][KIND_CPU] +=
+    st->accel_callbacks * s_costs[COST_ACCEL_CALLBACK] +
+    st->accel_samples * s_costs[COST_ACCEL_SAMPLE];
+  sheet->uas[SUBSYSTEM_BACKGROUND][KIND_CPU] += st->ticks * s_costs[COST_TICK];
+
+  for (uint32_t i = 0; i < st->num_callers; i++) {
+    const shim_caller_stats *caller = &st->callers[i];
+    double *row = sheet->uas[subsystem_of(caller->file)];
+    row[KIND_FLASH] += caller->events[SHIM_PERSIST_READ] * s_costs[COST_PERSIST_READ] +
+                       caller->events[SHIM_PERSIST_WRITE] * s_costs[COST_PERSIST_WRITE] +
+                       caller->events[SHIM_PERSIST_BYTES] * s_costs[COST_PERSIST_BYTE];
+    row[KIND_MESSAGES] += caller->events[SHIM_MESSAGE] * s_costs[COST_MESSAGE];
+    row[KIND_LAUNCHES] += caller->events[SHIM_LAUNCH] * s_costs[COST_LAUNCH];
+  }
+
+  sheet->uas[SUBSYSTEM_ALARM][KIND_VIBE] +=
+    app->vibe_ms / 1000.0 * s_costs[COST_VIBE];
+  sheet->uas[SUBSYSTEM_ALARM][KIND_CPU] += app->timers * s_costs[COST_APP_TIMER];
+}
+
+static double row_total(const energy_sheet *sheet, Subsystem s) {
+  double total = 0;
+  for (int k = 0; k < KINDS; k++)
+    total += sheet->uas[s][k];
+  return total;
+}
+
+// mAh per night for each subsystem, split by kind of charge
+void energy_report(const energy_app *app, double nights) {
+  energy_sheet sheet;
+  fill_sheet(app, &sheet);
+  double scale = 1.0 / (UAS_PER_MAH * nights);
+  printf("energy           mAh/night over %.1f night%s, costs from %s\n",
+         nights, nights == 1.0 ? "" : "s", s_table);
+  printf("  %-14s", "");
+  for (int k = 0; k < KINDS; k++)
+    printf(" %8s", s_kind_names[k]);
+  printf(" %8s\n", "total");
+  double columns[KINDS] = {0}, total = 0;
+  for (int s = 0; s < SUBSYSTEMS; s++) {
+    double row = row_total(&sheet, s);
+    if (s == SUBSYSTEM_OTHER && row == 0)
+      continue;
+    printf("  %-14s", s_subsystem_names[s]);
+    for (int k = 0; k < KINDS; k++) {
+      printf(" %8.4f", sheet.uas[s][k] * scale);
+      columns[k] += sheet.uas[s][k];
+    }
+    printf(" %8.4f\n", row * scale);
+    total += row;
+  }
+  printf("  %-14s", "total");
+  for (int k = 0; k < KINDS; k++)
+    printf(" %8.4f", columns[k] * scale);
+  printf(" %8.4f\n", total * scale);
+}
+
+// The same per subsystem, as a JSON object for the suite
+void energy_report_json(const energy_app *app, double nights) {
+  energy_sheet sheet;
+  fill_sheet(app, &sheet);
+  double scale = 1.0 / (UAS_PER_MAH * nights);
+  double total = 0;
+  printf("\"mah_per_night\": {");
+  for (int s = 0; s < SUBSYSTEMS; s++) {
+    double row = row_total(&sheet, s);
+    printf("\"%s\": %.4f, ", s_subsystem_names[s], row * scale);
+    total += row;
+  }
+  printf("\"total\": %.4f}, ", total * scale);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <pebble.h>
+
+// Energy model for a replayed night: the events the shims counted, each
+// charged from a per-event table (energy.txt) and added up by subsystem.
+// The figures are estimates for comparing builds and settings, not a
+// battery meter.
+
+// What the app did with the alarm, counted by the replay
+typedef struct energy_app {
+  uint64_t vibe_ms;     // motor on
+  uint64_t timers;      // app timers registered while it rang
+} energy_app;
+
+bool energy_load(const char *path);
+void energy_motor(const VibePattern *pattern);
+uint64_t energy_vibe_ms(void);
+void energy_report(const energy_app *app, double nights);
+void energy_report_json(const energy_app *app, double nights);
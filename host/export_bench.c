@@ -0,0 +1,212 @@
+// Runs the app's night export (src/c/export.c) against a mock phone that
+// behaves like src/js/export.js, over a lossy simulated link, and reports
+// throughput and retry behaviour.
+
+#include <pebble.h>
+#include <getopt.h>
+#include "app_shim.h"
+#include "shim.h"
+#include "export.h"
+#include "history.h"
+
+#define EXPORT_CMD_START    1
+#define PHONE_STALL_MS      5000
+#define PHONE_MAX_RESUMES   5
+#define SEND_TIMEOUT_MS     1000
+#define NOT_CONNECTED_MS    10
+#define SIM_LIMIT_MS        (10 * 60 * 1000)
+
+static uint8_t s_epochs[1000];
+static uint16_t s_num_epochs = 270;
+
+static double s_loss = 0.0;
+static uint32_t s_latency_ms = 50;
+static uint32_t s_us_per_byte = 100;
+static uint64_t s_disconnect_at = UINT64_MAX;
+static uint64_t s_disconnect_ms = 0;
+
+// Phone side state
+static uint8_t s_received[1024];
+static uint16_t s_received_size;
+static bool s_done;
+static bool s_verified;
+static AppTimer *s_stall_timer;
+static uint32_t s_resumes;
+static uint32_t s_failures;
+static uint32_t s_out_of_order;
+
+static uint32_t s_seed = 1;
+static double next_uniform(void) {
+  s_seed = s_seed * 1103515245 + 12345;
+  return ((s_seed >> 8) & 0xffff) / 65536.0;
+}
+
+static bool connected(void) {
+  return g_sim_ms < s_disconnect_at || 
+         g_sim_ms >= s_disconnect_at + s_disconnect_ms;
+}
+
+static uint32_t adler32(const uint8_t *data, uint16_t size) {
+  uint32_t a = 1, b = 0;
+  for (uint16_t i = 0; i < size; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return (b << 16) | a;
+}
+
+static void request_night(uint16_t offset) {
+  if (!connected())
+    return;
+  DictionaryIterator msg = {0};
+  dict_write_uint8(&msg, MESSAGE_KEY_ExportCommand, EXPORT_CMD_START);
+  dict_write_uint8(&msg, MESSAGE_KEY_ExportNight, 0);
+  dict_write_uint16(&msg, MESSAGE_KEY_ExportOffset, offset);
+  app_shim_phone_send(&msg);
+}
+
+static void stall_callback(void *data);
+
+static void arm_stall_timer(void) {
+  app_timer_cancel(s_stall_timer);
+  s_stall_timer = app_timer_register(PHONE_STALL_MS, stall_callback, NULL);
+}
+
+static void stall_callback(void *data) {
+  s_stall_timer = NULL;
+  if (s_done || s_resumes++ >= PHONE_MAX_RESUMES) {
+    s_done = true;
+    return;
+  }
+  request_night(s_received_size);
+  arm_stall_timer();
+}
+
+static uint16_t s_decoded;
+static bool s_decode_ok;
+static void check_epoch(uint8_t epoch, void *context) {
+  if (s_decoded >= s_num_epochs || s_epochs[s_decoded] != epoch)
+    s_decode_ok = false;
+  s_decoded++;
+}
+
+static void phone_take_chunk(const DictionaryIterator *message) {
+  Tuple *offset = dict_find(message, MESSAGE_KEY_ExportOffset);
+  Tuple *data = dict_find(message, MESSAGE_KEY_ExportData);
+  Tuple *total = dict_find(message, MESSAGE_KEY_ExportTotal);
+  Tuple *sum = dict_find(message, MESSAGE_KEY_ExportChecksum);
+  if (!offset || !data || !total || !sum || s_done)
+    return;
+  if (offset->value->uint16 != s_received_size) {
+    s_out_of_order++;
+    return;
+  }
+  memcpy(s_received + s_received_size, data->value->data, data->length);
+  s_received_size += data->length;
+  arm_stall_timer();
+  if (s_received_size >= total->value->uint16) {
+    s_done = true;
+    app_timer_cancel(s_stall_timer);
+    s_stall_timer = NULL;
+    s_verified = adler32(s_received, s_received_size) == sum->value->uint32;
+  }
+}
+
+// Every message costs a fixed round trip plus airtime for its bytes; some
+// are lost and time out, and nothing gets through while disconnected
+static AppMessageResult phone_link(const DictionaryIterator *message,
+                                      uint32_t *latency_ms) {
+  if (!connected()) {
+    *latency_ms = NOT_CONNECTED_MS;
+    s_failures++;
+    return APP_MSG_NOT_CONNECTED;
+  }
+  if (next_uniform() < s_loss) {
+    *latency_ms = SEND_TIMEOUT_MS;
+    s_failures++;
+    return APP_MSG_SEND_TIMEOUT;
+  }
+  uint32_t bytes = 0;
+  for (int i = 0; i < message->count; i++)
+    bytes += 7 + message->tuples[i].length;
+  *latency_ms = s_latency_ms + bytes * s_us_per_byte / 1000;
+  return APP_MSG_OK;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-n epochs] [-l loss] [-L latency_ms] [-b us_per_byte] "
+          "[-D at_ms:for_ms] [-S seed] [-v]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  while ((opt = getopt(argc, argv, "n:l:L:b:D:S:vh")) != -1) {
+    switch (opt) {
+      case 'n': s_num_epochs = (uint16_t)atoi(optarg); break;
+      case 'l': s_loss = atof(optarg); break;
+      case 'L': s_latency_ms = (uint32_t)atoi(optarg); break;
+      case 'b': s_us_per_byte = (uint32_t)atoi(optarg); break;
+      case 'S': s_seed = (uint32_t)atoi(optarg); break;
+      case 'D': {
+        unsigned long long at, len;
+        if (sscanf(optarg, "%llu:%llu", &at, &len) != 2) {
+          usage(argv[0]);
+          return 2;
+        }
+        s_disconnect_at = at;
+        s_disconnect_ms = len;
+        break;
+      }
+      case 'v': g_shim_verbose = true; break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (s_num_epochs > sizeof(s_epochs))
+    s_num_epochs = sizeof(s_epochs);
+
+  // Record a night through the worker's history store
+  uint32_t seed = s_seed;
+  history_begin(1767308400);
+  for (uint16_t i = 0; i < s_num_epochs; i++) {
+    uint32_t r = (uint32_t)(next_uniform() * 100);
+    s_epochs[i] = r < 60 ? 0 : r < 80 ? r % 3 : r < 95 ? r % 20 : 
+                  (uint8_t)(next_uniform() * 256);
+    history_append(s_epochs[i]);
+  }
+  history_finish();
+  s_seed = seed;
+  memset(&g_shim_stats, 0, sizeof(g_shim_stats));
+
+  app_shim_set_phone(phone_link, phone_take_chunk);
+  export_init();
+  request_night(0);
+  arm_stall_timer();
+  while (!s_done && g_sim_ms < SIM_LIMIT_MS && app_shim_step())
+    ;
+
+  // The night may have been cut short if it outgrew its history slot
+  history_night night;
+  history_get_night(0, &night);
+  s_decode_ok = true;
+  s_decoded = 0;
+  if (s_verified)
+    history_decode(0, check_epoch, NULL);
+  
+  printf("epochs           %u/%u stored\n", night.num_epochs, s_num_epochs);
+  printf("bytes            %u\n", s_received_size);
+  printf("messages         %llu\n", (unsigned long long)g_shim_stats.messages_sent);
+  printf("failed sends     %u\n", s_failures);
+  printf("resumes          %u\n", s_resumes);
+  printf("out of order     %u\n", s_out_of_order);
+  printf("sim time         %llu ms\n", (unsigned long long)g_sim_ms);
+  printf("throughput       %.0f B/s\n", g_sim_ms ? 
+         s_received_size * 1000.0 / g_sim_ms : 0.0);
+  printf("checksum         %s\n", s_verified ? "ok" : "FAILED");
+  s_decode_ok = s_decode_ok && s_decoded == night.num_epochs;
+  printf("decoded          %s\n", s_verified && s_decode_ok ? "ok" : "FAILED");
+  export_deinit();
+  return s_verified && s_decode_ok ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+#pragma once
+// Host stand-in for the parts of the Pebble app API that the app-side
+// transport code uses, on top of the worker subset.
+
+#include <pebble_worker.h>
+
+#define PBL_IF_ROUND_ELSE(if_true, if_false) (if_false)
+#define PBL_IF_COLOR_ELSE(if_true, if_false) (if_false)
+
+// Timers, run by whoever drives the host event loop
+typedef struct AppTimer AppTimer;
+typedef void (*AppTimerCallback)(void *data);
+
+AppTimer *app_timer_register(uint32_t timeout_ms, AppTimerCallback callback,
+                             void *callback_data);
+void app_timer_cancel(AppTimer *timer_handle);
+bool app_timer_reschedule(AppTimer *timer_handle, uint32_t new_timeout_ms);
+
+// Vibes, played by the fake motor in app_shim.c
+typedef struct {
+  const uint32_t *durations;
+  uint32_t num_segments;
+} VibePattern;
+
+void vibes_enqueue_custom_pattern(VibePattern pattern);
+void vibes_cancel(void);
+
+// Wakeups and the worker, as seen from the app
+typedef int32_t WakeupId;
+
+WakeupId wakeup_schedule(time_t timestamp, int32_t cookie, bool notify_if_missed);
+void wakeup_cancel(WakeupId wakeup_id);
+void wakeup_cancel_all(void);
+bool app_worker_is_running(void);
+AppWorkerResult app_worker_launch(void);
+AppWorkerResult app_worker_kill(void);
+
+// Dictionaries
+#define DICT_MAX_TUPLES       64
+#define DICT_MAX_DATA         256
+
+typedef enum {
+  TUPLE_BYTE_ARRAY = 0,
+  TUPLE_CSTRING = 1,
+  TUPLE_UINT = 2,
+  TUPLE_INT = 3,
+} TupleType;
+
+typedef union {
+  uint8_t data[DICT_MAX_DATA];
+  char cstring[DICT_MAX_DATA];
+  uint8_t uint8;
+  uint16_t uint16;
+  uint32_t uint32;
+  int8_t int8;
+  int16_t int16;
+  int32_t int32;
+} TupleValue;
+
+typedef struct {
+  uint32_t key;
+  TupleType type;
+  uint16_t length;
+  TupleValue value[1];
+} Tuple;
+
+// Like the firmware's, a dictionary takes a 1 B header and 7 B per tuple
+// on top of the values, and writes fail once the buffer is full. A
+// capacity of 0 is unlimited, for messages the mock phone builds.
+typedef struct {
+  uint8_t count;
+  uint32_t size;
+  uint32_t capacity;
+  Tuple tuples[DICT_MAX_TUPLES];
+} DictionaryIterator;
+
+typedef enum {
+  DICT_OK = 0,
+  DICT_NOT_ENOUGH_STORAGE = 1 << 1,
+  DICT_INVALID_ARGS = 1 << 2,
+} DictionaryResult;
+
+DictionaryResult dict_write_data(DictionaryIterator *iter, const uint32_t key,
+                                 const uint8_t *data, const uint16_t size);
+DictionaryResult dict_write_cstring(DictionaryIterator *iter, const uint32_t key,
+                                    const char * const cstring);
+DictionaryResult dict_write_uint8(DictionaryIterator *iter, const uint32_t key,
+                                  const uint8_t value);
+DictionaryResult dict_write_uint16(DictionaryIterator *iter, const uint32_t key,
+                                   const uint16_t value);
+DictionaryResult dict_write_uint32(DictionaryIterator *iter, const uint32_t key,
+                                   const uint32_t value);
+DictionaryResult dict_write_int32(DictionaryIterator *iter, const uint32_t key,
+                                  const int32_t value);
+Tuple *dict_find(const DictionaryIterator *iter, const uint32_t key);
+uint32_t dict_calc_buffer_size(const uint8_t tuple_count, ...);
+
+// AppMessage, delivered to a mock phone endpoint
+typedef enum {
+  APP_MSG_OK = 0,
+  APP_MSG_SEND_TIMEOUT = 1 << 1,
+  APP_MSG_SEND_REJECTED = 1 << 2,
+  APP_MSG_NOT_CONNECTED = 1 << 3,
+  APP_MSG_BUSY = 1 << 6,
+  APP_MSG_OUT_OF_MEMORY = 1 << 10,
+} AppMessageResult;
+
+typedef void (*AppMessageInboxReceived)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageOutboxSent)(DictionaryIterator *iterator, void *context);
+typedef void (*AppMessageOutboxFailed)(DictionaryIterator *iterator,
+                                       AppMessageResult reason, void *context);
+
+AppMessageResult app_message_open(const uint32_t size_inbound,
+                                  const uint32_t size_outbound);
+void app_message_deregister_callbacks(void);
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback);
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback);
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback);
+AppMessageResult app_message_outbox_begin(DictionaryIterator **iterator);
+AppMessageResult app_message_outbox_send(void);
+uint32_t app_message_outbox_size_maximum(void);
+
+// Message keys, as generated from package.json
+#define MESSAGE_KEY_ExportCommand     10000
+#define MESSAGE_KEY_ExportNight       10001
+#define MESSAGE_KEY_ExportOffset      10002
+#define MESSAGE_KEY_ExportData        10003
+#define MESSAGE_KEY_ExportTotal       10004
+#define MESSAGE_KEY_ExportChecksum    10005
+#define MESSAGE_KEY_ExportStartTime   10006
+#define MESSAGE_KEY_ExportEpochs      10007
+#define MESSAGE_KEY_SampleRate        10008
+#define MESSAGE_KEY_BatchSamples      10009
+#define MESSAGE_KEY_BufferMinutes     10010
+#define MESSAGE_KEY_BinMinutes        10011
+#define MESSAGE_KEY_PreRecordMinutes  10012
+#define MESSAGE_KEY_Detector          10013
+#define MESSAGE_KEY_AlarmTime1        10014
+#define MESSAGE_KEY_AlarmTime2        10015
+#define MESSAGE_KEY_AlarmTime3        10016
+#define MESSAGE_KEY_AlarmDays0        10017
+#define MESSAGE_KEY_AlarmDays1        10024
+#define MESSAGE_KEY_AlarmDays2        10031
+#define MESSAGE_KEY_AlarmDays3        10038
+#define MESSAGE_KEY_AlarmWindow       10045
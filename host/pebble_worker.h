@@ -0,0 +1,159 @@
+#pragma once
+// Host stand-in for the Pebble SDK worker header. Only the parts of the
+// API the worker uses are declared; the fakes live in shim.c and are
+// driven by replay.c.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SECONDS_PER_MINUTE        60
+#define SECONDS_PER_HOUR          3600
+#define SECONDS_PER_DAY           86400
+
+#define ARRAY_LENGTH(array)       (sizeof((array))/sizeof((array)[0]))
+
+#define PERSIST_DATA_MAX_LENGTH   256
+#define PERSIST_STRING_MAX_LENGTH PERSIST_DATA_MAX_LENGTH
+
+typedef int32_t status_t;
+#define S_SUCCESS                 0
+#define E_DOES_NOT_EXIST          -9
+#define E_OUT_OF_STORAGE          -8
+
+// Logging
+typedef enum {
+  APP_LOG_LEVEL_ERROR = 1,
+  APP_LOG_LEVEL_WARNING = 50,
+  APP_LOG_LEVEL_INFO = 100,
+  APP_LOG_LEVEL_DEBUG = 200,
+  APP_LOG_LEVEL_DEBUG_VERBOSE = 255,
+} AppLogLevel;
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number,
+             const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+#define APP_LOG(level, fmt, ...) \
+  app_log(level, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+
+// Time
+typedef enum {
+  SECOND_UNIT = 1 << 0,
+  MINUTE_UNIT = 1 << 1,
+  HOUR_UNIT = 1 << 2,
+  DAY_UNIT = 1 << 3,
+  MONTH_UNIT = 1 << 4,
+  YEAR_UNIT = 1 << 5,
+} TimeUnits;
+
+typedef void (*TickHandler)(struct tm *tick_time, TimeUnits units_changed);
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler);
+void tick_timer_service_unsubscribe(void);
+
+// The worker only ever sees the replay clock
+time_t shim_time(time_t *tloc);
+#define time(tloc) shim_time(tloc)
+uint16_t time_ms(time_t *t_utc, uint16_t *out_ms);
+time_t time_start_of_today(void);
+
+// Accelerometer
+typedef struct __attribute__((__packed__)) {
+  int16_t x;
+  int16_t y;
+  int16_t z;
+  bool did_vibrate;
+  uint64_t timestamp;
+} AccelData;
+
+typedef enum {
+  ACCEL_SAMPLING_10HZ = 10,
+  ACCEL_SAMPLING_25HZ = 25,
+  ACCEL_SAMPLING_50HZ = 50,
+  ACCEL_SAMPLING_100HZ = 100,
+} AccelSamplingRate;
+
+typedef void (*AccelDataHandler)(AccelData *data, uint32_t num_samples);
+
+void accel_data_service_subscribe(uint32_t samples_per_update,
+                                  AccelDataHandler handler);
+void accel_data_service_unsubscribe(void);
+int accel_service_set_sampling_rate(AccelSamplingRate rate);
+int accel_service_set_samples_per_update(uint32_t num_samples);
+
+// Persistent storage
+bool persist_exists(const uint32_t key);
+int persist_get_size(const uint32_t key);
+int32_t persist_read_int(const uint32_t key);
+bool persist_read_bool(const uint32_t key);
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size);
+status_t persist_write_int(const uint32_t key, const int32_t value);
+status_t persist_write_bool(const uint32_t key, const bool value);
+int persist_write_data(const uint32_t key, const void *data, const size_t size);
+status_t persist_delete(const uint32_t key);
+
+// Flash traffic, worker messages and app launches are charged to the
+// source file that asked for them, for the energy model (energy.c).
+// shim.c undefines these to provide the real thing.
+extern const char *g_shim_caller;
+#define SHIM_CALLER(call)     (g_shim_caller = __FILE__, call)
+#define persist_read_int(key)                 SHIM_CALLER(persist_read_int(key))
+#define persist_read_bool(key)                SHIM_CALLER(persist_read_bool(key))
+#define persist_read_data(key, buffer, size)  SHIM_CALLER(persist_read_data(key, buffer, size))
+#define persist_write_int(key, value)         SHIM_CALLER(persist_write_int(key, value))
+#define persist_write_bool(key, value)        SHIM_CALLER(persist_write_bool(key, value))
+#define persist_write_data(key, data, size)   SHIM_CALLER(persist_write_data(key, data, size))
+
+// Health minute history, as on the platforms that have it. The shim
+// records every minute of the replay once shim_set_health is on.
+#define PBL_HEALTH
+
+typedef struct {
+  uint8_t steps;
+  uint8_t orientation;
+  uint16_t vmc;
+  bool is_invalid: 1;
+  uint8_t light: 3;
+  uint8_t padding: 4;
+  uint8_t heart_rate_bpm;
+  uint8_t reserved[6];
+} HealthMinuteData;
+
+uint32_t health_service_get_minute_history(HealthMinuteData *minute_data,
+                                           uint32_t max_records,
+                                           time_t *time_start, time_t *time_end);
+
+// App <-> worker
+typedef struct {
+  uint16_t data0;
+  uint16_t data1;
+  uint16_t data2;
+} AppWorkerMessage;
+
+typedef enum {
+  APP_WORKER_RESULT_SUCCESS = 0,
+  APP_WORKER_RESULT_NOT_RUNNING = 2,
+} AppWorkerResult;
+
+typedef void (*AppWorkerMessageHandler)(uint16_t type, AppWorkerMessage *data);
+
+bool app_worker_message_subscribe(AppWorkerMessageHandler handler);
+bool app_worker_message_unsubscribe(void);
+AppWorkerResult app_worker_send_message(uint8_t type, AppWorkerMessage *data);
+AppWorkerResult worker_launch_app(void);
+#define app_worker_send_message(type, data)   SHIM_CALLER(app_worker_send_message(type, data))
+#define worker_launch_app()                   SHIM_CALLER(worker_launch_app())
+void worker_event_loop(void);
+
+// Heap, routed through the shim so allocations can be counted
+void *shim_malloc(size_t size);
+void *shim_calloc(size_t count, size_t size);
+void *shim_realloc(void *ptr, size_t size);
+void shim_free(void *ptr);
+#define malloc(size)          shim_malloc(size)
+#define calloc(count, size)   shim_calloc(count, size)
+#define realloc(ptr, size)    shim_realloc(ptr, size)
+#define free(ptr)             shim_free(ptr)
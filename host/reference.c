@@ -0,0 +1,50 @@
+#include <pebble_worker.h>
+#include "reference.h"
+
+#define SQRT_MAGIC_F 0x5f3759df
+
+// Inverse square root by the magic constant and three Newton steps, as
+// worker_src/c/math.c had it
+float sm_sqrt(const float x) {
+  const float xhalf = 0.5f*x;
+  union {
+    float x;
+    int i;
+  } u;
+  u.x = x;
+  u.i = SQRT_MAGIC_F - (u.i >> 1);
+  u.x = u.x*(1.5f - xhalf*u.x*u.x);
+  u.x = u.x*(1.5f - xhalf*u.x*u.x);
+  return x*u.x*(1.5f - xhalf*u.x*u.x);
+}
+
+// accel_data_handler's loop before the kernels. The sum of squares can
+// pass INT_MAX on hard knocks; it wraps here as it did on the watch.
+uint16_t reference_count_float(const AccelData *data, uint32_t num_samples,
+                               uint16_t *counted) {
+  uint16_t count = 0;
+  int16_t x, y, z, x_prev = 0, y_prev = 0, z_prev = 0;
+  float l;
+  const AccelData *dx = data;
+  for (uint32_t i = 0; i < num_samples; i++, dx++) {
+    if (dx->did_vibrate)
+      continue;
+    (*counted)++;
+    x = dx->x;
+    y = dx->y;
+    z = dx->z;
+    l = sm_sqrt((int32_t)((uint32_t)(x*x) + (uint32_t)(y*y) + (uint32_t)(z*z)));
+    x -= (x/l)*1000;
+    y -= (y/l)*1000;
+    z -= (z/l)*1000;
+    if ((x > 0 && x_prev < 0) || (x < 0 && x_prev > 0) ||
+        (y > 0 && y_prev < 0) || (y < 0 && y_prev > 0) ||
+        (z > 0 && z_prev < 0) || (z < 0 && z_prev > 0)) {
+      count++;
+    }
+    x_prev = x;
+    y_prev = y;
+    z_prev = z;
+  }
+  return count;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <pebble_worker.h>
+
+// The zero-crossing count as the worker did it before the integer kernels
+// (worker_src/c/kernel.h): each axis less 1000*v/|a| in float, |a| from
+// sm_sqrt, truncated back to int16. Host only, to measure how far the
+// kernels have moved from it.
+
+float sm_sqrt(const float x);
+uint16_t reference_count_float(const AccelData *data, uint32_t num_samples,
+                               uint16_t *counted);
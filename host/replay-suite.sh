@@ -0,0 +1,55 @@
+#!/bin/sh
+# Replays every *.txt trace in a directory through worker-replay and prints
+# a JSON report with one night per line, so two builds can be compared with
+# a plain diff. Without a directory, synthetic nights with seeds 1-5 are
+# replayed instead. Options after the directory go to worker-replay; with
+# -F the summary adds up the batches where the float code differs.
+#
+#   host/replay-suite.sh [dir] [worker-replay options]
+
+cd "$(dirname "$0")" || exit 1
+dir=
+if [ $# -gt 0 ] && [ "${1#-}" = "$1" ]; then
+  dir=$1
+  shift
+fi
+
+runs() {
+  if [ -n "$dir" ]; then
+    for trace in "$dir"/*.txt; do
+      [ -e "$trace" ] || continue
+      ./worker-replay -j "$@" "$trace" 2>/dev/null || exit 1
+    done
+  else
+    for seed in 1 2 3 4 5; do
+      ./worker-replay -j -S $seed "$@" 2>/dev/null || exit 1
+    done
+  fi
+}
+
+runs "$@" | awk '
+  {
+    nights[NR] = $0
+    if ($0 ~ /"wake": "peak"/) peak++
+    else if ($0 ~ /"wake": "fallback"/) fallback++
+    if (match($0, /"wake_offset_s": -?[0-9]+/)) {
+      split(substr($0, RSTART, RLENGTH), kv, ": ")
+      offset += kv[2]
+      woke++
+    }
+    if (match($0, /"float_differ": [0-9]+/)) {
+      split(substr($0, RSTART, RLENGTH), kv, ": ")
+      float_differ += kv[2]
+      float_checked = 1
+    }
+  }
+  END {
+    print "{\"nights\": ["
+    for (i = 1; i <= NR; i++)
+      print "  " nights[i] (i < NR ? "," : "")
+    printf "], \"summary\": {\"nights\": %d, \"peak\": %d, \"fallback\": %d, ", NR, peak, fallback
+    printf "\"mean_wake_offset_s\": %s", woke ? sprintf("%.0f", offset / woke) : "null"
+    if (float_checked)
+      printf ", \"float_differ\": %d", float_differ
+    print "}}"
+  }'
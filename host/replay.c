@@ -0,0 +1,566 @@
+// Replays a recorded (or synthetic) night through the worker at
+// faster-than-real-time and reports how long the hot paths took.
+//
+// Trace format: one sample per line, "x y z [did_vibrate]" in mg, at the
+// rate given by -r. Lines starting with '#' are ignored, except that
+// "# start YYYY-MM-DD HH:MM", "# alarm HH:MM" and "# rate hz" before the
+// first sample stand in for the options that weren't given.
+//
+// With -E, an alarm the worker fires is also played through the app's
+// vibe sequence, and the night's events are costed from an energy table.
+// With -F, every batch is also counted by the float code the kernels
+// replaced (reference.c), and the batches where the two differ are
+// reported.
+
+#include <pebble_worker.h>
+#include <getopt.h>
+#include "shim.h"
+#include "app_shim.h"
+#include "energy.h"
+#include "reference.h"
+#include "kernel.h"
+#include "detector.h"
+#include "history.h"
+#include "params.h"
+#include "protocol.h"
+#include "status.h"
+#include "latency.h"
+#include "sequence.h"
+#include "settings.h"
+
+#define ALARM_HOUR_KEY        0
+#define ALARM_MINUTE_KEY      1
+#define DETECTOR_KEY          4
+
+#define DEFAULT_START         "2026-01-01 23:00"
+#define DEFAULT_ALARM_HOUR    7
+#define DEFAULT_ALARM_MINUTE  0
+#define SYNTHETIC_CYCLE_MIN   90
+#define MAX_EPOCHS            1024
+#define DEFAULT_RING_SECONDS  60
+
+int worker_main(void);
+void background_init(void);
+void background_deinit(void);
+
+static FILE *s_trace;
+static time_t s_start;
+static time_t s_end;
+static uint32_t s_rate = 10;
+static time_t s_restart = -1;
+static uint32_t s_query_minutes = 0;
+static time_t s_params_at = -1;
+static recording_params s_params;
+static int s_params_detector = -1;
+static bool s_energy;
+static uint32_t s_ring_seconds = DEFAULT_RING_SECONDS;
+static bool s_alarm_pending;
+static energy_app s_energy_app;
+static bool s_float_check;
+static uint64_t s_float_batches;
+static uint64_t s_float_differ;     // batches the kernel and the float code disagree on
+static uint64_t s_float_crossings;  // by this many crossings in all
+
+// Tiny deterministic generator so synthetic nights are reproducible
+static uint32_t s_seed = 1;
+static uint32_t next_rand(void) {
+  s_seed = s_seed * 1103515245 + 12345;
+  return (s_seed >> 16) & 0x7fff;
+}
+
+// Still wrist with occasional movement, more of it near each cycle's peak
+static bool synthetic_sample(uint64_t i, AccelData *sample) {
+  time_t t = s_start + i / s_rate;
+  if (t >= s_end)
+    return false;
+  uint32_t minute = (t - s_start) / SECONDS_PER_MINUTE;
+  uint32_t phase = minute % SYNTHETIC_CYCLE_MIN;
+  uint32_t restless = phase > SYNTHETIC_CYCLE_MIN - 20 ? 40 : 2;
+  int noise = (next_rand() % 100) < restless ? 150 : 3;
+  sample->x = (int16_t)((int)(next_rand() % (2*noise + 1)) - noise);
+  sample->y = (int16_t)((int)(next_rand() % (2*noise + 1)) - noise);
+  sample->z = (int16_t)(1000 + (int)(next_rand() % (2*noise + 1)) - noise);
+  sample->did_vibrate = false;
+  return true;
+}
+
+static bool trace_sample(AccelData *sample) {
+  char line[128];
+  while (fgets(line, sizeof(line), s_trace)) {
+    if (line[0] == '#')
+      continue;
+    int x, y, z, vibe = 0;
+    if (sscanf(line, "%d %d %d %d", &x, &y, &z, &vibe) < 3)
+      continue;
+    sample->x = (int16_t)x;
+    sample->y = (int16_t)y;
+    sample->z = (int16_t)z;
+    sample->did_vibrate = vibe != 0;
+    return true;
+  }
+  return false;
+}
+
+static void float_tap(const AccelData *data, uint32_t num_samples) {
+  uint16_t counted_kernel = 0, counted_float = 0;
+  uint16_t kernel = kernel_count(data, num_samples, &counted_kernel);
+  uint16_t old = reference_count_float(data, num_samples, &counted_float);
+  s_float_batches++;
+  if (kernel != old) {
+    s_float_differ++;
+    s_float_crossings += kernel > old ? kernel - old : old - kernel;
+  }
+}
+
+// Status replies from the worker, as the app would show them
+static void print_status(const worker_status *status) {
+  static const char *states[] = { "idle", "pre-recording", "wakeup window", "fired" };
+  time_t now = time(NULL);
+  time_t next = status->next_transition;
+  struct tm now_tm = *gmtime(&now);
+  struct tm next_tm = *gmtime(&next);
+  printf("[%02d:%02d] status %s until %02d:%02d, ring %u last %u, epoch %u in %u, "
+         "score %u%% mean %u\n", now_tm.tm_hour, now_tm.tm_min,
+         status->state < 4 ? states[status->state] : "?",
+         next_tm.tm_hour, next_tm.tm_min, status->ring_fill, status->last_epoch,
+         status->count, status->samples, status->score, status->mean);
+}
+
+static void app_message_handler(uint16_t type, AppWorkerMessage *message) {
+  if (protocol_command(message) == PROTOCOL_ALARM_FIRED)
+    s_alarm_pending = true;
+  else
+    status_handle_message(message);
+}
+
+// The app's side of a fired alarm, as main.c runs it on a worker launch:
+// vibes first, then the backstop wakeup and the latency record, then the
+// sequence until the wearer stops it after the ring time
+static void play_alarm(void) {
+  s_alarm_pending = false;
+  time_t now = time(NULL);
+  g_sim_ms = (uint64_t)now * 1000;
+  uint64_t timers = g_app_shim_stats.timers_registered;
+  latency_start(true);
+  sequence_start();
+  latency_mark(LATENCY_VIBE);
+  schedule_alarm_wakeup(current_alarm_time(now));
+  latency_mark(LATENCY_WINDOW);
+  latency_report();
+  uint64_t stop = g_sim_ms + (uint64_t)s_ring_seconds * 1000;
+  while (sequence_running() && app_shim_step() && g_sim_ms < stop)
+    ;
+  g_sim_ms = stop;
+  sequence_stop();
+  s_energy_app.timers += g_app_shim_stats.timers_registered - timers;
+  s_energy_app.vibe_ms = energy_vibe_ms();
+}
+
+// Store the -p parameters as the settings page would and tell the worker
+static void apply_params(void) {
+  persist_write_data(PARAMS_KEY, &s_params, sizeof(s_params));
+  if (s_params_detector >= 0)
+    persist_write_int(DETECTOR_KEY, s_params_detector);
+  if (s_params_at < 0)
+    return;
+  APP_LOG(APP_LOG_LEVEL_INFO, "Changing the recording parameters");
+  AppWorkerMessage message = { .data0 = PROTOCOL_PARAMS };
+  shim_send_to_worker(PROTOCOL_SENDER_APP, &message);
+}
+
+// Stand-in for the firmware event loop: advance the clock sample by sample,
+// firing minute ticks on the boundaries
+void worker_event_loop(void) {
+  AccelData sample;
+  time_t last_minute = s_start - s_start % SECONDS_PER_MINUTE;
+  for (uint64_t i = 0; ; i++) {
+    time_t t = s_start + i / s_rate;
+    uint16_t ms = (uint16_t)((i % s_rate) * 1000 / s_rate);
+    while (t - t % SECONDS_PER_MINUTE > last_minute) {
+      last_minute += SECONDS_PER_MINUTE;
+      shim_set_clock(last_minute, 0);
+      if (last_minute == s_restart) {
+        APP_LOG(APP_LOG_LEVEL_INFO, "Restarting the worker");
+        background_deinit();
+        background_init();
+      }
+      if (last_minute == s_params_at)
+        apply_params();
+      shim_tick();
+      if (s_alarm_pending)
+        play_alarm();
+      if (s_query_minutes &&
+          (last_minute - s_start) / SECONDS_PER_MINUTE % s_query_minutes == 0)
+        status_query(print_status);
+    }
+    shim_set_clock(t, ms);
+    if (!(s_trace ? trace_sample(&sample) : synthetic_sample(i, &sample)))
+      break;
+    shim_accel_push(&sample);
+    if (s_alarm_pending)
+      play_alarm();
+  }
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-a HH:MM] [-s 'YYYY-MM-DD HH:MM'] [-d hours] [-r hz] [-k HH:MM] [-t detector]\n"
+          "          [-S seed] [-q minutes] [-p params[@HH:MM]] [-E table] [-w seconds] [-H] [-F] [-j] [-v]\n"
+          "          [trace]\n"
+          "  -a  alarm time (default %02d:%02d)\n"
+          "  -s  UTC start of the recording (default %s)\n"
+          "  -d  length of the synthetic night (default: until 1 h past the alarm)\n"
+          "  -r  sample rate of the trace (default 10)\n"
+          "  -k  kill and restart the worker at this time\n"
+          "  -t  wake detector: bins, ema or cole-kripke (default: build default)\n"
+          "  -S  seed for the synthetic night (default 1)\n"
+          "  -q  ask the worker for its status this often, as the app does\n"
+          "  -p  recording parameters as name=value,... from rate, batch, window,\n"
+          "      bin, pre (minutes) and detector; from the start, or changed live at HH:MM\n"
+          "  -E  estimate the battery used per night from this energy table\n"
+          "  -w  with -E, how long the alarm rings before it is stopped (default %d s)\n"
+          "  -H  keep Health minute history, for the worker to seed its ring from\n"
+          "  -F  compare the crossing kernel with the old float code on every batch\n"
+          "  -j  print the report as one line of JSON\n"
+          "  -v  show worker debug logs\n",
+          argv0, DEFAULT_ALARM_HOUR, DEFAULT_ALARM_MINUTE, DEFAULT_START,
+          DEFAULT_RING_SECONDS);
+}
+
+static time_t parse_start(const char *s) {
+  struct tm tm = {0};
+  if (sscanf(s, "%d-%d-%d %d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+             &tm.tm_hour, &tm.tm_min) != 5)
+    return (time_t)-1;
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  return mktime(&tm);
+}
+
+static int parse_detector(const char *s) {
+  static const char *names[DETECTOR_COUNT] = {
+    [DETECTOR_BINS] = "bins",
+    [DETECTOR_EMA] = "ema",
+    [DETECTOR_COLE_KRIPKE] = "cole-kripke",
+  };
+  for (int i = 0; i < DETECTOR_COUNT; i++) {
+    if (strcmp(s, names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+// Settings page values for -p, over whatever the worker has by default
+static bool parse_params(const char *spec) {
+  params_load();
+  s_params = g_params;
+  char buf[128];
+  snprintf(buf, sizeof(buf), "%s", spec);
+  char *at = strchr(buf, '@');
+  if (at) {
+    *at++ = '\0';
+    int hour, minute;
+    if (sscanf(at, "%d:%d", &hour, &minute) != 2)
+      return false;
+    s_params_at = hour * SECONDS_PER_HOUR + minute * SECONDS_PER_MINUTE;
+  }
+  for (char *item = strtok(buf, ","); item; item = strtok(NULL, ",")) {
+    char name[16], value[16];
+    if (sscanf(item, "%15[^=]=%15s", name, value) != 2)
+      return false;
+    int n = atoi(value);
+    if (strcmp(name, "rate") == 0)
+      s_params.sample_rate = n;
+    else if (strcmp(name, "batch") == 0)
+      s_params.batch_samples = n;
+    else if (strcmp(name, "window") == 0)
+      s_params.buffer_minutes = n;
+    else if (strcmp(name, "bin") == 0)
+      s_params.bin_minutes = n;
+    else if (strcmp(name, "pre") == 0)
+      s_params.pre_recording_minutes = n;
+    else if (strcmp(name, "detector") == 0 &&
+             (s_params_detector = parse_detector(value)) >= 0)
+      continue;
+    else
+      return false;
+  }
+  return true;
+}
+
+// Header comments at the top of a trace, left for the options to override
+static void read_trace_header(char *start, size_t start_size, char *alarm,
+                              size_t alarm_size, uint32_t *rate) {
+  char line[128];
+  long pos = ftell(s_trace);
+  while (fgets(line, sizeof(line), s_trace) && line[0] == '#') {
+    char value[64];
+    unsigned int hz;
+    if (sscanf(line, "# start %63[0-9: -]", value) == 1)
+      snprintf(start, start_size, "%s", value);
+    else if (sscanf(line, "# alarm %63[0-9:]", value) == 1)
+      snprintf(alarm, alarm_size, "%s", value);
+    else if (sscanf(line, "# rate %u", &hz) == 1)
+      *rate = hz;
+    pos = ftell(s_trace);
+  }
+  fseek(s_trace, pos, SEEK_SET);
+}
+
+typedef struct epoch_series {
+  uint16_t num_epochs;
+  uint8_t epochs[MAX_EPOCHS];
+} epoch_series;
+
+static void add_epoch(uint8_t epoch, void *context) {
+  epoch_series *series = context;
+  if (series->num_epochs < MAX_EPOCHS)
+    series->epochs[series->num_epochs++] = epoch;
+}
+
+// Peak if the worker woke us before the alarm, fallback if at or after it
+static const char *wake_kind(time_t alarm) {
+  if (g_shim_stats.app_launches == 0)
+    return "none";
+  return g_shim_stats.last_launch_time < alarm ? "peak" : "fallback";
+}
+
+static void report(time_t alarm) {
+  shim_stats *st = &g_shim_stats;
+  printf("accel callbacks  %llu\n", (unsigned long long)st->accel_callbacks);
+  printf("accel samples    %llu\n", (unsigned long long)st->accel_samples);
+  printf("ns/sample        %.1f\n", st->accel_samples ?
+         (double)st->accel_ns / st->accel_samples : 0.0);
+  printf("accel on         %llu:%02llu\n",
+         (unsigned long long)st->accel_seconds / SECONDS_PER_HOUR,
+         (unsigned long long)st->accel_seconds / SECONDS_PER_MINUTE % 60);
+  printf("minute ticks     %llu\n", (unsigned long long)st->ticks);
+  printf("ns/tick          %.1f\n", st->ticks ?
+         (double)st->tick_ns / st->ticks : 0.0);
+  printf("persist reads    %llu\n", (unsigned long long)st->persist_reads);
+  printf("persist writes   %llu (%llu B)\n",
+         (unsigned long long)st->persist_writes,
+         (unsigned long long)st->persist_bytes_written);
+  printf("allocations      %llu (%llu B, %llu in handlers)\n",
+         (unsigned long long)st->allocs,
+         (unsigned long long)st->alloc_bytes,
+         (unsigned long long)st->handler_allocs);
+  printf("worker messages  %llu\n", (unsigned long long)st->messages_sent);
+  printf("app launches     %llu\n", (unsigned long long)st->app_launches);
+  if (st->app_launches) {
+    struct tm *t = gmtime(&st->last_launch_time);
+    printf("last launch      %02d:%02d (%s, %+ld min)\n", t->tm_hour, t->tm_min,
+           wake_kind(alarm), (long)(st->last_launch_time - alarm) / SECONDS_PER_MINUTE);
+  }
+  if (s_float_check)
+    printf("float reference  %llu of %llu batches differ, by %llu crossings\n",
+           (unsigned long long)s_float_differ, (unsigned long long)s_float_batches,
+           (unsigned long long)s_float_crossings);
+}
+
+// One object per run, so a corpus report is one night per line
+static void report_json(const char *name, time_t alarm, const char *detector,
+                        double nights) {
+  shim_stats *st = &g_shim_stats;
+  static epoch_series series;
+  series.num_epochs = 0;
+  if (history_num_nights() > 0)
+    history_decode(0, add_epoch, &series);
+
+  printf("{\"night\": \"%s\", \"detector\": \"%s\", \"alarm\": %ld, ",
+         name, detector, (long)alarm);
+  printf("\"wake\": \"%s\", ", wake_kind(alarm));
+  if (st->app_launches)
+    printf("\"wake_offset_s\": %ld, ", (long)(st->last_launch_time - alarm));
+  else
+    printf("\"wake_offset_s\": null, ");
+  printf("\"accel_seconds\": %llu, \"accel_samples\": %llu, \"ns_per_sample\": %.1f, ",
+         (unsigned long long)st->accel_seconds, (unsigned long long)st->accel_samples, st->accel_samples ?
+         (double)st->accel_ns / st->accel_samples : 0.0);
+  printf("\"ticks\": %llu, \"ns_per_tick\": %.1f, ",
+         (unsigned long long)st->ticks, st->ticks ?
+         (double)st->tick_ns / st->ticks : 0.0);
+  printf("\"allocs\": %llu, \"alloc_bytes\": %llu, \"handler_allocs\": %llu, ",
+         (unsigned long long)st->allocs, (unsigned long long)st->alloc_bytes,
+         (unsigned long long)st->handler_allocs);
+  if (s_energy)
+    energy_report_json(&s_energy_app, nights);
+  if (s_float_check)
+    printf("\"float_batches\": %llu, \"float_differ\": %llu, \"float_crossings\": %llu, ",
+           (unsigned long long)s_float_batches, (unsigned long long)s_float_differ,
+           (unsigned long long)s_float_crossings);
+  printf("\"persist_writes\": %llu, \"epochs\": [",
+         (unsigned long long)st->persist_writes);
+  for (uint16_t i = 0; i < series.num_epochs; i++)
+    printf(i ? ",%u" : "%u", series.epochs[i]);
+  printf("]}\n");
+}
+
+int main(int argc, char **argv) {
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  char start[64] = DEFAULT_START, alarm_opt[64] = "";
+  uint32_t rate = 0;
+  int restart_hour = -1, restart_minute = 0;
+  int detector = -1;
+  bool json = false;
+  bool health = false;
+  bool start_given = false;
+  double hours = -1;
+  int opt;
+  bool params = false;
+  while ((opt = getopt(argc, argv, "a:s:d:r:k:t:S:q:p:E:w:HFjvh")) != -1) {
+    switch (opt) {
+      case 'a':
+        snprintf(alarm_opt, sizeof(alarm_opt), "%s", optarg);
+        break;
+      case 's':
+        snprintf(start, sizeof(start), "%s", optarg);
+        start_given = true;
+        break;
+      case 'd':
+        hours = atof(optarg);
+        break;
+      case 'r':
+        rate = (uint32_t)atoi(optarg);
+        if (rate == 0) {
+          usage(argv[0]);
+          return 2;
+        }
+        break;
+      case 'k':
+        if (sscanf(optarg, "%d:%d", &restart_hour, &restart_minute) != 2) {
+          usage(argv[0]);
+          return 2;
+        }
+        break;
+      case 't':
+        detector = parse_detector(optarg);
+        if (detector < 0) {
+          usage(argv[0]);
+          return 2;
+        }
+        break;
+      case 'S':
+        s_seed = (uint32_t)strtoul(optarg, NULL, 0);
+        break;
+      case 'q':
+        s_query_minutes = (uint32_t)atoi(optarg);
+        break;
+      case 'p':
+        if (!parse_params(optarg)) {
+          usage(argv[0]);
+          return 2;
+        }
+        params = true;
+        break;
+      case 'E':
+        if (!energy_load(optarg))
+          return 2;
+        s_energy = true;
+        break;
+      case 'w':
+        s_ring_seconds = (uint32_t)atoi(optarg);
+        break;
+      case 'H':
+        health = true;
+        break;
+      case 'F':
+        s_float_check = true;
+        g_shim_accel_tap = float_tap;
+        break;
+      case 'j':
+        json = true;
+        break;
+      case 'v':
+        g_shim_verbose = true;
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  char name[64];
+  snprintf(name, sizeof(name), "synthetic-%u", (unsigned int)s_seed);
+  char header_start[64] = "", header_alarm[64] = "";
+  uint32_t header_rate = 0;
+  if (optind < argc) {
+    s_trace = fopen(argv[optind], "r");
+    if (s_trace == NULL) {
+      perror(argv[optind]);
+      return 1;
+    }
+    const char *base = strrchr(argv[optind], '/');
+    snprintf(name, sizeof(name), "%s", base ? base + 1 : argv[optind]);
+    read_trace_header(header_start, sizeof(header_start), header_alarm,
+                      sizeof(header_alarm), &header_rate);
+  }
+
+  // Options win over the trace header, which wins over the defaults
+  s_start = parse_start(!start_given && header_start[0] ? header_start : start);
+  s_rate = rate ? rate : header_rate ? header_rate : s_rate;
+  const char *alarm_str = alarm_opt[0] ? alarm_opt : header_alarm;
+  int hour = DEFAULT_ALARM_HOUR, minute = DEFAULT_ALARM_MINUTE;
+  if ((alarm_str[0] && sscanf(alarm_str, "%d:%d", &hour, &minute) != 2) ||
+      s_start == (time_t)-1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // Synthetic nights run until an hour past the next alarm
+  time_t alarm = s_start - s_start % SECONDS_PER_DAY +
+                 hour * SECONDS_PER_HOUR + minute * SECONDS_PER_MINUTE;
+  while (alarm < s_start)
+    alarm += SECONDS_PER_DAY;
+  if (restart_hour >= 0) {
+    s_restart = s_start - s_start % SECONDS_PER_DAY +
+                restart_hour * SECONDS_PER_HOUR +
+                restart_minute * SECONDS_PER_MINUTE;
+    while (s_restart < s_start)
+      s_restart += SECONDS_PER_DAY;
+  }
+  s_end = hours >= 0 ? s_start + (time_t)(hours * SECONDS_PER_HOUR) :
+                       alarm + SECONDS_PER_HOUR;
+  if (s_params_at >= 0) {
+    s_params_at += s_start - s_start % SECONDS_PER_DAY;
+    while (s_params_at < s_start)
+      s_params_at += SECONDS_PER_DAY;
+  }
+
+  shim_set_clock(s_start, 0);
+  shim_set_source_rate(s_rate);
+  persist_write_int(ALARM_HOUR_KEY, hour);
+  persist_write_int(ALARM_MINUTE_KEY, minute);
+  if (detector >= 0)
+    persist_write_int(DETECTOR_KEY, detector);
+  if (params && s_params_at < 0)
+    apply_params();
+  memset(&g_shim_stats, 0, sizeof(g_shim_stats));
+  if (s_query_minutes || s_energy)
+    shim_set_app_handler(app_message_handler);
+  if (s_energy)
+    app_shim_set_motor(energy_motor);
+  shim_set_health(health);
+
+  uint64_t started = shim_nanos();
+  worker_main();
+  double wall = (shim_nanos() - started) / 1e9;
+
+  if (s_trace)
+    fclose(s_trace);
+  // Costs are per night, and a replay of several nights is spread over them
+  time_t span = time(NULL) - s_start;
+  double nights = (double)((span + SECONDS_PER_DAY / 2) / SECONDS_PER_DAY);
+  if (nights < 1)
+    nights = 1;
+  if (json) {
+    report_json(name, alarm, detector_name(), nights);
+    return 0;
+  }
+  report(alarm);
+  printf("wall time        %.3f s\n", wall);
+  if (s_energy)
+    energy_report(&s_energy_app, nights);
+  return 0;
+}
@@ -0,0 +1,120 @@
+// Plays the progressive alarm (src/c/sequence.c) against a fake vibe
+// motor, next to the old one-timer-per-pulse loop, checks that the motor
+// is on at exactly the same milliseconds, and reports the timers and
+// patterns each takes. Then checks that the alarm plays the same with no
+// memory to compose it in, and that stopping the alarm silences it.
+
+#include <pebble.h>
+#include <getopt.h>
+#include "app_shim.h"
+#include "shim.h"
+#include "sequence.h"
+
+#define MAX_MS          (10 * 60 * 1000)
+#define STOP_MS         100000
+
+static uint8_t s_on[MAX_MS];
+static uint64_t s_busy_until;
+
+// The firmware's vibe queue: a pattern starts once the one before it is
+// done, and cancelling drops whatever has not played yet
+static void motor(const VibePattern *pattern) {
+  if (pattern == NULL) {
+    for (uint64_t t = g_sim_ms; t < s_busy_until && t < MAX_MS; t++)
+      s_on[t] = 0;
+    s_busy_until = g_sim_ms;
+    return;
+  }
+  uint64_t t = s_busy_until > g_sim_ms ? s_busy_until : g_sim_ms;
+  for (uint32_t i = 0; i < pattern->num_segments; i++) {
+    for (uint32_t ms = 0; ms < pattern->durations[i]; ms++, t++) {
+      if (t < MAX_MS)
+        s_on[t] = i % 2 == 0;
+    }
+  }
+  s_busy_until = t;
+}
+
+static void reset(void) {
+  memset(s_on, 0, sizeof(s_on));
+  s_busy_until = 0;
+  g_sim_ms = 0;
+  memset(&g_app_shim_stats, 0, sizeof(g_app_shim_stats));
+}
+
+// The alarm loop as it was before sequence.c, one timer per pulse
+static uint16_t s_count;
+
+static void plain_step(void *data) {
+  if (s_count >= sequence_pulses())
+    return;
+  VibePattern pattern;
+  uint8_t delay;
+  sequence_pulse(s_count, &pattern, &delay);
+  vibes_enqueue_custom_pattern(pattern);
+  s_count++;
+  app_timer_register((uint32_t)delay * 1000, plain_step, NULL);
+}
+
+static void report(const char *name) {
+  printf("%-10s %5llu timers %5llu patterns %5llu segments, %llu ms\n", name,
+         (unsigned long long)g_app_shim_stats.timers_registered,
+         (unsigned long long)g_app_shim_stats.vibe_patterns,
+         (unsigned long long)g_app_shim_stats.vibe_segments,
+         (unsigned long long)g_sim_ms);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  while ((opt = getopt(argc, argv, "vh")) != -1) {
+    switch (opt) {
+      case 'v':
+        g_shim_verbose = true;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+  app_shim_set_motor(motor);
+
+  static uint8_t plain[MAX_MS];
+  reset();
+  s_count = 0;
+  plain_step(NULL);
+  while (app_shim_step())
+    ;
+  report("plain");
+  memcpy(plain, s_on, sizeof(plain));
+
+  reset();
+  sequence_start();
+  while (app_shim_step())
+    ;
+  report("composed");
+  bool same = memcmp(plain, s_on, sizeof(plain)) == 0 && !sequence_running();
+  printf("vibes      %s\n", same ? "same" : "DIFFERENT");
+
+  reset();
+  g_shim_out_of_memory = true;
+  sequence_start();
+  g_shim_out_of_memory = false;
+  while (app_shim_step())
+    ;
+  report("no memory");
+  bool fallback = memcmp(plain, s_on, sizeof(plain)) == 0 && !sequence_running();
+  printf("fallback   %s\n", fallback ? "same" : "DIFFERENT");
+
+  // Stop partway through a burst
+  reset();
+  sequence_start();
+  while (app_shim_step() && g_sim_ms < STOP_MS)
+    ;
+  sequence_stop();
+  bool silent = !app_shim_step();
+  for (uint64_t t = g_sim_ms; t < MAX_MS; t++)
+    silent = silent && !s_on[t];
+  printf("stop       %s\n", silent ? "silent" : "STILL VIBRATING");
+
+  return same && fallback && silent ? 0 : 1;
+}
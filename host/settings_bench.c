@@ -0,0 +1,186 @@
+// Holds Up on the main screen through the app's settings cache
+// (src/c/settings.c), with the worker linked in to receive the changes,
+// and reports the flash traffic and worker messages that causes. Then
+// opens the app inside the alarm's window, before and after the worker
+// fires it, to check where the backstop goes, and sends a second alarm
+// from the settings page to check it reaches the worker. Last, sets a
+// daily alarm the evening before clocks go forward, to check both sides
+// ring it at the local time and not an hour off.
+
+#include <pebble.h>
+#include <getopt.h>
+#include "app_shim.h"
+#include "shim.h"
+#include "settings.h"
+#include "store.h"
+
+#define DEFAULT_START       "2026-01-01 21:00"
+#define REPEAT_MS           50    // TIME_CHANGE_REPEAT_DURATION in ui.c
+#define STEP_MINUTES        5     // TIME_CHANGE_RESOLUTION in ui.c
+#define START_HOUR          7
+#define DST_TZ              "EST5EDT,M3.2.0,M11.1.0"
+#define DST_EVENING         "2026-03-07 21:00"    // the Saturday before the change
+
+void background_init(void);
+void background_deinit(void);
+bool params_received(DictionaryIterator *iter);
+extern time_t alarm_time;
+
+static uint32_t s_repeats = 40;
+static uint32_t s_done = 0;
+
+// The worker's event loop is never entered here
+void worker_event_loop(void) {
+}
+
+static void repeat_click(void *data) {
+  uint32_t hour, minute;
+  change_alarm_time(&hour, &minute, STEP_MINUTES);
+  if (++s_done < s_repeats)
+    app_timer_register(REPEAT_MS, repeat_click, NULL);
+}
+
+// Turning the alarm on inside its window arms the backstop for that alarm,
+// unless the worker has fired it already, and then for the next one
+static bool check_backstop(time_t alarm) {
+  time_t now = alarm - 10 * SECONDS_PER_MINUTE;
+  shim_set_clock(now, 0);
+  persist_delete(FIRE_STAMP_KEY);
+  set_alarm_state(true);
+  bool before = g_app_shim_stats.last_wakeup == alarm + SECONDS_PER_MINUTE;
+
+  fire_stamp fired = { .seconds = now - SECONDS_PER_MINUTE };
+  persist_write_data(FIRE_STAMP_KEY, &fired, sizeof(fired));
+  set_alarm_state(true);
+  bool after = g_app_shim_stats.last_wakeup == alarm + SECONDS_PER_DAY + SECONDS_PER_MINUTE;
+
+  printf("backstop         %s before firing, %s after\n",
+         before ? "ok" : "WRONG", after ? "ok" : "WRONG");
+  return before && after;
+}
+
+// The page adds a second alarm five minutes before the next one, on that
+// weekday only, as Clay sends it: the time as text, a flag per day and
+// the window
+static bool check_page(time_t next) {
+  struct tm *t = localtime(&next);
+  time_t at = next - 5 * SECONDS_PER_MINUTE;
+  struct tm *a = localtime(&at);
+  char text[8];
+  snprintf(text, sizeof(text), "%02d:%02d", a->tm_hour, a->tm_min);
+  DictionaryIterator page = {0};
+  dict_write_cstring(&page, MESSAGE_KEY_AlarmTime1, text);
+  for (int day = 0; day < 7; day++)
+    dict_write_uint8(&page, MESSAGE_KEY_AlarmDays1 + day, day == t->tm_wday);
+  dict_write_uint8(&page, MESSAGE_KEY_AlarmWindow + 1, 20);
+  bool taken = params_received(&page);
+  while (app_shim_step())
+    ;
+  alarm_slot alarm;
+  get_alarm_slot(1, &alarm);
+  bool ok = taken && alarm.days == 1 << t->tm_wday && alarm.window_minutes == 20 &&
+            alarm_time == at;
+  printf("page alarm       %s at %s, worker %s\n", ok ? "ok" : "WRONG", text,
+         alarm_time == at ? "has it" : "MISSED IT");
+  return ok;
+}
+
+static time_t parse_local(const char *text) {
+  struct tm tm = {0};
+  sscanf(text, "%d-%d-%d %d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+         &tm.tm_hour, &tm.tm_min);
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  tm.tm_isdst = -1;
+  return mktime(&tm);
+}
+
+// A 07:00 alarm set on Saturday evening falls on Sunday after the clocks
+// have gone forward, at 07:00 summer time
+static bool check_dst(void) {
+  setenv("TZ", DST_TZ, 1);
+  tzset();
+  time_t evening = parse_local(DST_EVENING);
+  // Ten hours on, less the hour the clocks skip
+  time_t expect = evening + 10 * SECONDS_PER_HOUR - SECONDS_PER_HOUR;
+  shim_set_clock(evening, 0);
+  persist_delete(FIRE_STAMP_KEY);
+  alarm_slot off = {0};
+  alarm_slot daily = { .hour = 7, .minute = 0, .days = ALARM_EVERY_DAY, .window_minutes = 30 };
+  set_alarm_slot(1, &off);
+  set_alarm_slot(0, &daily);
+  while (app_shim_step())
+    ;
+  struct tm *t = localtime(&alarm_time);
+  bool worker = alarm_time == expect;
+  bool backstop = g_app_shim_stats.last_wakeup == expect + SECONDS_PER_MINUTE;
+  printf("dst              worker %02d:%02d %s, backstop %s\n", t->tm_hour, t->tm_min,
+         worker ? "ok" : "WRONG", backstop ? "ok" : "WRONG");
+  setenv("TZ", "UTC", 1);
+  tzset();
+  return worker && backstop;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-n repeats] [-v]\n"
+          "  -n  button repeats while held (default 40)\n"
+          "  -v  show debug logs\n", argv0);
+}
+
+int main(int argc, char **argv) {
+  setenv("TZ", "UTC", 1);
+  tzset();
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:vh")) != -1) {
+    switch (opt) {
+      case 'n':
+        s_repeats = (uint32_t)atoi(optarg);
+        break;
+      case 'v':
+        g_shim_verbose = true;
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 2;
+    }
+  }
+
+  shim_set_clock(parse_local(DEFAULT_START), 0);
+
+  set_alarm_time(START_HOUR, 0);
+  set_alarm_state(true);
+  background_init();
+  memset(&g_shim_stats, 0, sizeof(g_shim_stats));
+  memset(&g_app_shim_stats, 0, sizeof(g_app_shim_stats));
+
+  uint64_t start_ms = g_sim_ms;
+  app_timer_register(0, repeat_click, NULL);
+  while (app_shim_step())
+    ;
+
+  uint32_t hour, minute;
+  get_alarm_time(&hour, &minute);
+  uint32_t expect = (START_HOUR * 60 + s_repeats * STEP_MINUTES) % (24 * 60);
+  struct tm *worker_tm = gmtime(&alarm_time);
+  uint32_t worker = worker_tm->tm_hour * 60 + worker_tm->tm_min;
+
+  printf("repeats          %u\n", (unsigned int)s_repeats);
+  printf("persist reads    %llu\n", (unsigned long long)g_shim_stats.persist_reads);
+  printf("persist writes   %llu (%llu B)\n",
+         (unsigned long long)g_shim_stats.persist_writes,
+         (unsigned long long)g_shim_stats.persist_bytes_written);
+  printf("worker messages  %llu\n", (unsigned long long)g_shim_stats.messages_sent);
+  printf("wakeups          %llu\n", (unsigned long long)g_app_shim_stats.wakeups_scheduled);
+  printf("committed after  %llu ms\n", (unsigned long long)(g_sim_ms - start_ms));
+  printf("app alarm        %02u:%02u\n", (unsigned int)hour, (unsigned int)minute);
+  printf("worker alarm     %02u:%02u\n", worker / 60, worker % 60);
+  bool ok = hour * 60 + minute == expect && worker == expect;
+  ok = check_backstop(alarm_time) && ok;
+  ok = check_page(alarm_time) && ok;
+  ok = check_dst() && ok;
+  background_deinit();
+  printf("settings         %s\n", ok ? "ok" : "MISMATCH");
+  return ok ? 0 : 1;
+}
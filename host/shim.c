@@ -0,0 +1,493 @@
+#include <pebble_worker.h>
+#include <stdarg.h>
+#include "shim.h"
+
+// The real allocator, for the counting wrappers below
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+// And the real calls behind the ones charged to their caller
+#undef persist_read_int
+#undef persist_read_bool
+#undef persist_read_data
+#undef persist_write_int
+#undef persist_write_bool
+#undef persist_write_data
+#undef app_worker_send_message
+#undef worker_launch_app
+
+#define PERSIST_MAX_KEYS        256
+#define ACCEL_MAX_BATCH         100
+#define HEALTH_MAX_MINUTES      (48 * 60)
+
+// Stand-in for Health's per-minute movement count: the sample to sample
+// change on each axis past a small dead band, summed over the minute
+#define HEALTH_DEAD_BAND        16
+#define HEALTH_VMC_DIVISOR      8
+#define SHIM_SENDER_WORKER      0
+#define SHIM_SENDER_APP         1
+
+shim_stats g_shim_stats;
+bool g_shim_verbose = false;
+bool g_shim_out_of_memory = false;
+void (*g_shim_accel_tap)(const AccelData *data, uint32_t num_samples);
+const char *g_shim_caller;
+
+static const uint32_t s_rates[SHIM_RATES] = { 10, 25, 50, 100 };
+
+static time_t s_now;
+static uint16_t s_now_ms;
+
+static TickHandler s_tick_handler;
+static TimeUnits s_tick_units;
+
+static AccelDataHandler s_accel_handler;
+static uint32_t s_accel_batch_size;
+static uint32_t s_accel_rate = ACCEL_SAMPLING_25HZ;
+static uint32_t s_source_rate = 10;
+static uint32_t s_rate_accum;
+static AccelData s_accel_batch[ACCEL_MAX_BATCH];
+static uint32_t s_accel_count;
+static time_t s_accel_since;
+
+static bool s_health;
+static time_t s_health_start;
+static time_t s_health_minute;
+static uint32_t s_health_minutes;
+static uint32_t s_health_sum;
+static AccelData s_health_prev;
+static uint16_t s_health_vmc[HEALTH_MAX_MINUTES];
+static void health_record(const AccelData *sample);
+
+static AppWorkerMessageHandler s_message_handler;
+static AppWorkerMessageHandler s_app_handler;
+static bool s_in_handler;
+
+typedef struct persist_entry {
+  bool used;
+  uint32_t key;
+  size_t size;
+  uint8_t data[PERSIST_DATA_MAX_LENGTH];
+} persist_entry;
+static persist_entry s_persist[PERSIST_MAX_KEYS];
+
+uint64_t shim_nanos(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Logging
+
+void app_log(uint8_t log_level, const char *src_filename, int src_line_number,
+             const char *fmt, ...) {
+  if (!g_shim_verbose && log_level > APP_LOG_LEVEL_INFO)
+    return;
+  struct tm *t = gmtime(&s_now);
+  fprintf(stderr, "[%02d:%02d:%02d] %s:%d ", t->tm_hour, t->tm_min, t->tm_sec,
+          src_filename, src_line_number);
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fputc('\n', stderr);
+}
+
+// Charge an event to whichever file made the call
+static void charge(ShimEvent event, uint64_t n) {
+  const char *file = g_shim_caller ? g_shim_caller : "?";
+  shim_caller_stats *caller = NULL;
+  for (uint32_t i = 0; i < g_shim_stats.num_callers; i++) {
+    if (strcmp(g_shim_stats.callers[i].file, file) == 0) {
+      caller = &g_shim_stats.callers[i];
+      break;
+    }
+  }
+  if (caller == NULL) {
+    if (g_shim_stats.num_callers == SHIM_MAX_CALLERS)
+      return;
+    caller = &g_shim_stats.callers[g_shim_stats.num_callers++];
+    caller->file = file;
+  }
+  caller->events[event] += n;
+}
+
+int shim_rate_index(uint32_t hz) {
+  for (int i = 0; i < SHIM_RATES; i++) {
+    if (s_rates[i] == hz)
+      return i;
+  }
+  return 0;
+}
+
+uint32_t shim_rate_hz(int index) {
+  return s_rates[index];
+}
+
+// Heap
+
+static void count_alloc(size_t size) {
+  g_shim_stats.allocs++;
+  g_shim_stats.alloc_bytes += size;
+  if (s_in_handler)
+    g_shim_stats.handler_allocs++;
+}
+
+void *shim_malloc(size_t size) {
+  count_alloc(size);
+  return g_shim_out_of_memory ? NULL : malloc(size);
+}
+
+void *shim_calloc(size_t count, size_t size) {
+  count_alloc(count * size);
+  return g_shim_out_of_memory ? NULL : calloc(count, size);
+}
+
+void *shim_realloc(void *ptr, size_t size) {
+  count_alloc(size);
+  return g_shim_out_of_memory ? NULL : realloc(ptr, size);
+}
+
+void shim_free(void *ptr) {
+  free(ptr);
+}
+
+// Time
+
+void shim_set_clock(time_t t, uint16_t ms) {
+  s_now = t;
+  s_now_ms = ms;
+}
+
+#undef time
+time_t shim_time(time_t *tloc) {
+  if (tloc)
+    *tloc = s_now;
+  return s_now;
+}
+
+uint16_t time_ms(time_t *t_utc, uint16_t *out_ms) {
+  if (t_utc)
+    *t_utc = s_now;
+  if (out_ms)
+    *out_ms = s_now_ms;
+  return s_now_ms;
+}
+
+time_t time_start_of_today(void) {
+  return s_now - s_now % SECONDS_PER_DAY;
+}
+
+void tick_timer_service_subscribe(TimeUnits tick_units, TickHandler handler) {
+  s_tick_units = tick_units;
+  s_tick_handler = handler;
+}
+
+void tick_timer_service_unsubscribe(void) {
+  s_tick_handler = NULL;
+}
+
+// Deliver a tick for the minute boundary at the current clock, if anyone
+// is listening for one of the units that changed
+bool shim_tick(void) {
+  if (s_tick_handler == NULL)
+    return false;
+  struct tm tick_time = *localtime(&s_now);
+  TimeUnits changed = MINUTE_UNIT;
+  if (tick_time.tm_min == 0)
+    changed |= HOUR_UNIT;
+  if (tick_time.tm_min == 0 && tick_time.tm_hour == 0)
+    changed |= DAY_UNIT;
+  if (!(s_tick_units & changed))
+    return false;
+  uint64_t start = shim_nanos();
+  s_tick_handler(&tick_time, changed);
+  g_shim_stats.tick_ns += shim_nanos() - start;
+  g_shim_stats.ticks++;
+  return true;
+}
+
+// Accelerometer
+
+void accel_data_service_subscribe(uint32_t samples_per_update,
+                                  AccelDataHandler handler) {
+  s_accel_handler = handler;
+  s_accel_batch_size = samples_per_update > ACCEL_MAX_BATCH ?
+                       ACCEL_MAX_BATCH : samples_per_update;
+  s_accel_count = 0;
+  s_rate_accum = 0;
+  s_accel_since = s_now;
+}
+
+// Time subscribed since the last change, at the rate it was sampled at
+static void close_accel_interval(void) {
+  if (s_accel_handler == NULL)
+    return;
+  g_shim_stats.accel_seconds += s_now - s_accel_since;
+  g_shim_stats.rate_seconds[shim_rate_index(s_accel_rate)] += s_now - s_accel_since;
+  s_accel_since = s_now;
+}
+
+void accel_data_service_unsubscribe(void) {
+  close_accel_interval();
+  s_accel_handler = NULL;
+  s_accel_count = 0;
+}
+
+int accel_service_set_sampling_rate(AccelSamplingRate rate) {
+  close_accel_interval();
+  s_accel_rate = rate;
+  s_rate_accum = 0;
+  return 0;
+}
+
+int accel_service_set_samples_per_update(uint32_t num_samples) {
+  s_accel_batch_size = num_samples > ACCEL_MAX_BATCH ?
+                       ACCEL_MAX_BATCH : num_samples;
+  s_accel_count = 0;
+  return 0;
+}
+
+void shim_set_source_rate(uint32_t rate) {
+  s_source_rate = rate;
+  s_rate_accum = 0;
+}
+
+uint32_t shim_accel_rate(void) {
+  return s_accel_rate;
+}
+
+bool shim_accel_subscribed(void) {
+  return s_accel_handler != NULL;
+}
+
+// Feed one sample at the source rate; it is dropped or kept to match the
+// rate the worker asked for, and batches are delivered once full
+void shim_accel_push(const AccelData *sample) {
+  if (s_health)
+    health_record(sample);
+  if (s_accel_handler == NULL)
+    return;
+  s_rate_accum += s_accel_rate;
+  if (s_rate_accum < s_source_rate)
+    return;
+  s_rate_accum -= s_source_rate;
+
+  s_accel_batch[s_accel_count] = *sample;
+  s_accel_batch[s_accel_count].timestamp = (uint64_t)s_now * 1000 + s_now_ms;
+  if (++s_accel_count < s_accel_batch_size)
+    return;
+
+  uint32_t n = s_accel_count;
+  s_accel_count = 0;
+  if (g_shim_accel_tap)
+    g_shim_accel_tap(s_accel_batch, n);
+  uint64_t start = shim_nanos();
+  s_in_handler = true;
+  s_accel_handler(s_accel_batch, n);
+  s_in_handler = false;
+  g_shim_stats.accel_ns += shim_nanos() - start;
+  g_shim_stats.accel_callbacks++;
+  g_shim_stats.accel_samples += n;
+  g_shim_stats.rate_samples[shim_rate_index(s_accel_rate)] += n;
+}
+
+// Health
+
+void shim_set_health(bool on) {
+  s_health = on;
+  s_health_minutes = 0;
+  s_health_start = 0;
+}
+
+static uint32_t health_axis(int16_t a, int16_t b) {
+  int d = a > b ? a - b : b - a;
+  return d > HEALTH_DEAD_BAND ? d - HEALTH_DEAD_BAND : 0;
+}
+
+// Health sees every sample, whether or not the worker is subscribed
+static void health_record(const AccelData *sample) {
+  time_t minute = s_now - s_now % SECONDS_PER_MINUTE;
+  if (s_health_start == 0) {
+    s_health_start = s_health_minute = minute;
+    s_health_sum = 0;
+    s_health_prev = *sample;
+  }
+  while (minute > s_health_minute) {
+    uint32_t i = (s_health_minute - s_health_start) / SECONDS_PER_MINUTE;
+    if (i < HEALTH_MAX_MINUTES) {
+      uint32_t vmc = s_health_sum / HEALTH_VMC_DIVISOR;
+      s_health_vmc[i] = vmc > UINT16_MAX ? UINT16_MAX : vmc;
+      s_health_minutes = i + 1;
+    }
+    s_health_sum = 0;
+    s_health_minute += SECONDS_PER_MINUTE;
+  }
+  s_health_sum += health_axis(sample->x, s_health_prev.x) +
+                  health_axis(sample->y, s_health_prev.y) +
+                  health_axis(sample->z, s_health_prev.z);
+  s_health_prev = *sample;
+}
+
+// Complete minutes only, as Health writes each one when it ends
+uint32_t health_service_get_minute_history(HealthMinuteData *minute_data,
+                                           uint32_t max_records,
+                                           time_t *time_start, time_t *time_end) {
+  if (!s_health || s_health_minutes == 0)
+    return 0;
+  time_t first = *time_start - *time_start % SECONDS_PER_MINUTE;
+  if (first < s_health_start)
+    first = s_health_start;
+  time_t available = s_health_start + s_health_minutes * SECONDS_PER_MINUTE;
+  time_t last = *time_end < available ? *time_end : available;
+  uint32_t n = 0;
+  for (time_t t = first; t < last && n < max_records; t += SECONDS_PER_MINUTE, n++) {
+    memset(&minute_data[n], 0, sizeof(minute_data[n]));
+    minute_data[n].vmc = s_health_vmc[(t - s_health_start) / SECONDS_PER_MINUTE];
+  }
+  if (n == 0)
+    return 0;
+  *time_start = first;
+  *time_end = first + n * SECONDS_PER_MINUTE;
+  return n;
+}
+
+// Persistent storage
+
+static persist_entry *persist_find(uint32_t key) {
+  for (int i = 0; i < PERSIST_MAX_KEYS; i++) {
+    if (s_persist[i].used && s_persist[i].key == key)
+      return &s_persist[i];
+  }
+  return NULL;
+}
+
+static persist_entry *persist_slot(uint32_t key) {
+  persist_entry *e = persist_find(key);
+  if (e)
+    return e;
+  for (int i = 0; i < PERSIST_MAX_KEYS; i++) {
+    if (!s_persist[i].used) {
+      s_persist[i].used = true;
+      s_persist[i].key = key;
+      return &s_persist[i];
+    }
+  }
+  return NULL;
+}
+
+bool persist_exists(const uint32_t key) {
+  return persist_find(key) != NULL;
+}
+
+int persist_get_size(const uint32_t key) {
+  persist_entry *e = persist_find(key);
+  return e ? (int)e->size : E_DOES_NOT_EXIST;
+}
+
+int persist_read_data(const uint32_t key, void *buffer, const size_t buffer_size) {
+  g_shim_stats.persist_reads++;
+  charge(SHIM_PERSIST_READ, 1);
+  persist_entry *e = persist_find(key);
+  if (e == NULL)
+    return E_DOES_NOT_EXIST;
+  size_t n = e->size < buffer_size ? e->size : buffer_size;
+  memcpy(buffer, e->data, n);
+  return (int)n;
+}
+
+int32_t persist_read_int(const uint32_t key) {
+  int32_t value = 0;
+  persist_read_data(key, &value, sizeof(value));
+  return value;
+}
+
+bool persist_read_bool(const uint32_t key) {
+  bool value = false;
+  persist_read_data(key, &value, sizeof(value));
+  return value;
+}
+
+int persist_write_data(const uint32_t key, const void *data, const size_t size) {
+  persist_entry *e = persist_slot(key);
+  if (e == NULL)
+    return E_OUT_OF_STORAGE;
+  size_t n = size < PERSIST_DATA_MAX_LENGTH ? size : PERSIST_DATA_MAX_LENGTH;
+  memcpy(e->data, data, n);
+  e->size = n;
+  g_shim_stats.persist_writes++;
+  g_shim_stats.persist_bytes_written += n;
+  charge(SHIM_PERSIST_WRITE, 1);
+  charge(SHIM_PERSIST_BYTES, n);
+  return (int)n;
+}
+
+status_t persist_write_int(const uint32_t key, const int32_t value) {
+  int n = persist_write_data(key, &value, sizeof(value));
+  return n < 0 ? n : S_SUCCESS;
+}
+
+status_t persist_write_bool(const uint32_t key, const bool value) {
+  int n = persist_write_data(key, &value, sizeof(value));
+  return n < 0 ? n : S_SUCCESS;
+}
+
+status_t persist_delete(const uint32_t key) {
+  persist_entry *e = persist_find(key);
+  if (e == NULL)
+    return E_DOES_NOT_EXIST;
+  e->used = false;
+  return S_SUCCESS;
+}
+
+// App <-> worker
+
+bool app_worker_message_subscribe(AppWorkerMessageHandler handler) {
+  s_message_handler = handler;
+  return true;
+}
+
+bool app_worker_message_unsubscribe(void) {
+  s_message_handler = NULL;
+  return true;
+}
+
+// Messages go both ways through here. Those from the app (type 1) reach
+// the worker's handler when both are linked into the same host program,
+// and those from the worker reach the handler the host program set up
+// as the app.
+AppWorkerResult app_worker_send_message(uint8_t type, AppWorkerMessage *data) {
+  g_shim_stats.messages_sent++;
+  charge(SHIM_MESSAGE, 1);
+  APP_LOG(APP_LOG_LEVEL_INFO, "Worker message type %u (%u, %u, %u)",
+          type, data->data0, data->data1, data->data2);
+  if (type == SHIM_SENDER_APP && s_message_handler) {
+    s_message_handler(type, data);
+    return APP_WORKER_RESULT_SUCCESS;
+  }
+  if (type == SHIM_SENDER_WORKER && s_app_handler) {
+    s_app_handler(type, data);
+    return APP_WORKER_RESULT_SUCCESS;
+  }
+  return APP_WORKER_RESULT_NOT_RUNNING;
+}
+
+AppWorkerResult worker_launch_app(void) {
+  g_shim_stats.app_launches++;
+  charge(SHIM_LAUNCH, 1);
+  g_shim_stats.last_launch_time = s_now;
+  APP_LOG(APP_LOG_LEVEL_INFO, "Worker launched the app");
+  return APP_WORKER_RESULT_SUCCESS;
+}
+
+void shim_set_app_handler(AppWorkerMessageHandler handler) {
+  s_app_handler = handler;
+}
+
+// Pretend the app sent the worker a message
+void shim_send_to_worker(uint16_t type, AppWorkerMessage *message) {
+  if (s_message_handler)
+    s_message_handler(type, message);
+}
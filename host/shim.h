@@ -0,0 +1,64 @@
+#pragma once
+#include <pebble_worker.h>
+
+// Accelerometer sampling rates the firmware offers, 10 25 50 and 100 Hz
+#define SHIM_RATES            4
+
+// Events charged to the file that caused them
+typedef enum {
+  SHIM_PERSIST_READ,
+  SHIM_PERSIST_WRITE,
+  SHIM_PERSIST_BYTES,         // written
+  SHIM_MESSAGE,
+  SHIM_LAUNCH,
+  SHIM_EVENTS,
+} ShimEvent;
+
+#define SHIM_MAX_CALLERS      32
+
+typedef struct shim_caller_stats {
+  const char *file;           // __FILE__ of the caller
+  uint64_t events[SHIM_EVENTS];
+} shim_caller_stats;
+
+// Counters for everything the worker asked of the fake firmware
+typedef struct shim_stats {
+  uint64_t accel_callbacks;
+  uint64_t accel_samples;
+  uint64_t accel_ns;
+  uint64_t accel_seconds;    // subscribed to the accelerometer
+  uint64_t rate_seconds[SHIM_RATES];  // of those, at each sampling rate
+  uint64_t rate_samples[SHIM_RATES];  // delivered at each sampling rate
+  uint64_t ticks;
+  uint64_t tick_ns;
+  uint64_t persist_reads;
+  uint64_t persist_writes;
+  uint64_t persist_bytes_written;
+  uint64_t messages_sent;
+  uint64_t app_launches;
+  time_t last_launch_time;
+  uint64_t allocs;
+  uint64_t alloc_bytes;
+  uint64_t handler_allocs;   // made from inside the accel handler
+  uint32_t num_callers;
+  shim_caller_stats callers[SHIM_MAX_CALLERS];
+} shim_stats;
+
+extern shim_stats g_shim_stats;
+extern bool g_shim_verbose;
+extern bool g_shim_out_of_memory;  // malloc and friends return NULL
+// Sees every batch just before the worker's accel handler does
+extern void (*g_shim_accel_tap)(const AccelData *data, uint32_t num_samples);
+
+void shim_set_clock(time_t t, uint16_t ms);
+void shim_set_source_rate(uint32_t rate);
+uint32_t shim_accel_rate(void);
+bool shim_accel_subscribed(void);
+void shim_accel_push(const AccelData *sample);
+void shim_set_health(bool on);
+bool shim_tick(void);
+void shim_send_to_worker(uint16_t type, AppWorkerMessage *message);
+void shim_set_app_handler(AppWorkerMessageHandler handler);
+uint64_t shim_nanos(void);
+int shim_rate_index(uint32_t hz);
+uint32_t shim_rate_hz(int index);
@@ -0,0 +1,53 @@
+#pragma once
+
+// Messages between the app and the worker. data0 holds the command in its
+// low byte and a sequence number in its high byte; a reply carries the
+// sequence number of the query it answers, and the worker's own messages
+// carry 0. Include after pebble.h or pebble_worker.h, which both define
+// AppWorkerMessage; each side sends with its own protocol_send
+// (src/c/protocol.c, worker_src/c/protocol.c).
+
+#define PROTOCOL_SENDER_WORKER    0
+#define PROTOCOL_SENDER_APP       1
+
+typedef enum {
+  // App to worker
+  PROTOCOL_RELOAD = 1,              // re-read the settings
+  PROTOCOL_ALARM_SLOT = 2,          // one alarm slot, see below
+  PROTOCOL_QUERY_STATUS = 3,        // answered by the four status parts
+  PROTOCOL_PARAMS = 4,              // re-read the recording parameters
+
+  // Worker to app
+  PROTOCOL_ALARM_FIRED = 16,        // data1: woke on a peak
+  PROTOCOL_STATUS_RECORDING = 17,   // data1: ring fill, data2: state, detector, last epoch
+  PROTOCOL_STATUS_EPOCH = 18,       // data1: crossings so far, data2: samples so far
+  PROTOCOL_STATUS_SCORE = 19,       // data1: detector score, data2: window mean
+  PROTOCOL_STATUS_NEXT = 20,        // data1, data2: next transition time, high half first
+} ProtocolCommand;
+
+// An alarm slot carries the slot in data1 above the minute of the day, and
+// the window in minutes in data2 above the weekday mask
+#define PROTOCOL_SLOT_SHIFT       11
+#define PROTOCOL_WINDOW_SHIFT     7
+
+// The recording part packs the worker state above the detector above the
+// last closed epoch
+#define PROTOCOL_STATE_SHIFT      12
+#define PROTOCOL_DETECTOR_SHIFT   8
+
+static inline ProtocolCommand protocol_command(const AppWorkerMessage *message) {
+  return (ProtocolCommand)(message->data0 & 0xff);
+}
+
+static inline uint8_t protocol_seq(const AppWorkerMessage *message) {
+  return message->data0 >> 8;
+}
+
+// Sends as PROTOCOL_SENDER_APP from the app and PROTOCOL_SENDER_WORKER from
+// the worker
+void protocol_send(ProtocolCommand command, uint8_t seq, uint16_t data1,
+                   uint16_t data2);
+
+// App only. Sequence numbers are taken before sending, since the worker can
+// answer before app_worker_send_message returns
+uint8_t protocol_next_seq(void);
@@ -0,0 +1,78 @@
+#include <string.h>
+#include "store.h"
+
+#define MINUTES_PER_DAY       (24 * 60)
+
+// Turn the alarms into the sorted weekly table. Two alarms at the same
+// minute become one entry with the wider window.
+void schedule_compile(const alarm_slot slots[ALARM_SLOTS], schedule_table *table) {
+  table->num_entries = 0;
+  for (uint8_t slot = 0; slot < ALARM_SLOTS; slot++) {
+    const alarm_slot *alarm = &slots[slot];
+    for (uint8_t day = 0; day < 7; day++) {
+      if (!(alarm->days & (1 << day)))
+        continue;
+      schedule_entry entry = {
+        .minute_of_week = day * MINUTES_PER_DAY + alarm->hour * 60 + alarm->minute,
+        .window_minutes = alarm->window_minutes,
+        .slot = slot,
+      };
+
+      // Insertion sort, the table is tiny
+      int i = table->num_entries;
+      while (i > 0 && table->entries[i - 1].minute_of_week > entry.minute_of_week)
+        i--;
+      if (i > 0 && table->entries[i - 1].minute_of_week == entry.minute_of_week) {
+        schedule_entry *same = &table->entries[i - 1];
+        if (same->window_minutes < entry.window_minutes)
+          same->window_minutes = entry.window_minutes;
+        continue;
+      }
+      memmove(&table->entries[i + 1], &table->entries[i],
+              (table->num_entries - i) * sizeof(schedule_entry));
+      table->entries[i] = entry;
+      table->num_entries++;
+    }
+  }
+}
+
+// An entry's minute of the week as a time, in the week (from Sunday) that
+// holds now or that many weeks after it. mktime keeps it on the local
+// clock's minute across a daylight saving change, which counting seconds
+// from the start of the week would not.
+time_t schedule_entry_time(time_t now, uint16_t minute_of_week, uint16_t weeks) {
+  struct tm t = *localtime(&now);
+  t.tm_mday += weeks * 7 - t.tm_wday + minute_of_week / MINUTES_PER_DAY;
+  t.tm_hour = minute_of_week % MINUTES_PER_DAY / 60;
+  t.tm_min = minute_of_week % 60;
+  t.tm_sec = 0;
+  t.tm_isdst = -1;
+  return mktime(&t);
+}
+
+// The encoding is described in store.h
+uint16_t history_decode_bytes(const uint8_t *data, uint16_t size, uint16_t num_epochs,
+                              uint8_t *value, HistoryEpochHandler handler,
+                              void *context) {
+  uint16_t decoded = 0;
+  uint16_t i = 0;
+  while (i < size && decoded < num_epochs) {
+    uint8_t token = data[i++];
+    uint8_t count = (token & HISTORY_TOKEN_COUNT) + 1;
+    if (!(token & HISTORY_TOKEN_RUN)) {
+      int16_t delta = (token & 1) ? -(int16_t)((token + 1) >> 1) : (int16_t)(token >> 1);
+      *value += delta;
+      handler(*value, context);
+      decoded++;
+    } else if ((token & HISTORY_TOKEN_KIND) == HISTORY_TOKEN_RUN) {
+      for (; count > 0 && decoded < num_epochs; count--, decoded++)
+        handler(*value, context);
+    } else {
+      for (; count > 0 && i < size && decoded < num_epochs; count--, decoded++) {
+        *value = data[i++];
+        handler(*value, context);
+      }
+    }
+  }
+  return decoded;
+}
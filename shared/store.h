@@ -0,0 +1,168 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Persist keys and layouts that one of the app and the worker writes and
+// the other reads back. The two share one persist store, and both builds
+// take this directory (wscript, host/Makefile), so each layout is defined
+// once, here.
+
+// The alarms, written by src/c/settings.c and read by it and by
+// worker_src/c/schedule.c, which both compile them into the week's
+// schedule with schedule_compile and turn its entries into times with
+// schedule_entry_time. Older versions kept one daily alarm under the hour
+// and minute keys.
+#define ALARM_HOUR_KEY        0
+#define ALARM_MINUTE_KEY      1
+#define ALARMS_KEY            5
+#define ALARM_SLOTS           4
+#define ALARM_EVERY_DAY       0x7f
+#define DEFAULT_WINDOW_MINUTES  30
+
+typedef struct alarm_slot {
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t days;             // bit n rings on weekday n, Sunday is 0
+  uint8_t window_minutes;   // how early the worker may wake us
+} alarm_slot;
+
+// The week's alarms sorted by minute of the week. Walking to the next
+// alarm is one step along the table.
+#define SCHEDULE_MAX_ENTRIES  (ALARM_SLOTS * 7)
+
+typedef struct schedule_entry {
+  uint16_t minute_of_week;  // from Sunday 00:00 local time
+  uint8_t window_minutes;   // how early the alarm may ring
+  uint8_t slot;             // alarm it came from
+} schedule_entry;
+
+typedef struct schedule_table {
+  uint8_t num_entries;
+  schedule_entry entries[SCHEDULE_MAX_ENTRIES];
+} schedule_table;
+
+void schedule_compile(const alarm_slot slots[ALARM_SLOTS], schedule_table *table);
+time_t schedule_entry_time(time_t now, uint16_t minute_of_week, uint16_t weeks);
+
+// Recording parameters from the settings page on the phone, written by
+// src/c/params.c and checked and applied by worker_src/c/params.c
+#define PARAMS_KEY            6
+#define PARAMS_VERSION        1
+#define PARAMS_MAX_PRE_RECORDING  (8 * 60)
+
+typedef struct recording_params {
+  uint8_t version;
+  uint8_t sample_rate;            // Hz: 10, 25 or 50
+  uint8_t batch_samples;          // samples per accelerometer callback
+  uint8_t bin_minutes;            // bins detector bin length
+  uint16_t buffer_minutes;        // window the detectors look at
+  uint16_t pre_recording_minutes; // recording starts this long before the window
+} recording_params;
+
+#define PARAMS_DEFAULTS ((recording_params) { \
+  .version = PARAMS_VERSION, \
+  .sample_rate = 10, \
+  .batch_samples = 25, \
+  .bin_minutes = 10, \
+  .buffer_minutes = 2 * 60, \
+  .pre_recording_minutes = 4 * 60, \
+})
+
+// The worker's counters for the newest night, written by
+// worker_src/c/stats.c and shown by src/c/diagnostics.c
+#define STATS_KEY             300
+#define STATS_VERSION         3
+
+typedef enum {
+  STATS_FIRE_NONE,
+  STATS_FIRE_PEAK,
+  STATS_FIRE_FALLBACK,
+} StatsFire;
+
+typedef struct worker_stats {
+  uint8_t version;
+  uint8_t open;           // night still being recorded
+  uint8_t fire;           // StatsFire
+  uint8_t detector;       // DetectorType in use
+  int32_t start_time;
+  uint32_t batches;       // accel_data_handler calls
+  uint32_t samples;
+  uint32_t vibe_samples;  // discarded because the watch vibrated
+  uint32_t accel_ms;      // time in accel_data_handler
+  uint16_t accel_max_ms;  // longest single batch
+  uint16_t ring_fill;     // epochs in the ring when the alarm fired
+  uint32_t peak_checks;   // is_local_max calls
+  uint32_t peak_ms;       // time in is_local_max
+  uint16_t epochs;
+  uint16_t quiet_epochs;  // epochs sampled at the reduced rate
+  uint16_t seeded_epochs; // taken from Health before sampling started
+  uint16_t reserved;
+  uint32_t accel_seconds; // accelerometer subscribed
+  recording_params params;// as last applied
+} worker_stats;
+
+// When the worker last fired an alarm, written by
+// worker_src/c/background.c and read by src/c/latency.c to time the
+// launch and by src/c/settings.c to skip an alarm that has already rung
+#define FIRE_STAMP_KEY        310
+
+typedef struct fire_stamp {
+  int32_t seconds;
+  uint16_t ms;
+} fire_stamp;
+
+// Night history, written by worker_src/c/history.c and read by
+// src/c/nights.c for the graph and the export
+#define HISTORY_INDEX_KEY       200
+#define HISTORY_DATA_KEY        210
+#define HISTORY_VERSION         2
+#define HISTORY_NIGHTS          5
+#define HISTORY_BLOCK_SIZE      64
+
+// The longest night the settings allow, the most pre-recording and the
+// widest alarm window, fits whatever the wearer did: no epoch takes more
+// than a byte, and the headers of literal groups add at most a byte per
+// 64 epochs, per block and per worker restart.
+#define HISTORY_MAX_EPOCHS      (PARAMS_MAX_PRE_RECORDING + UINT8_MAX)
+#define HISTORY_BLOCKS          ((HISTORY_MAX_EPOCHS + HISTORY_MAX_EPOCHS / 16) / \
+                                 HISTORY_BLOCK_SIZE + 1)
+
+#define HISTORY_BLOCK_KEY(slot, block)  (HISTORY_DATA_KEY + (slot) * HISTORY_BLOCKS + (block))
+
+typedef struct history_night {
+  int32_t start_time;   // time of the first epoch
+  uint16_t num_epochs;  // epochs stored
+  uint16_t num_bytes;   // encoded size
+  uint8_t last_value;   // newest epoch, the base for the next delta
+  uint8_t open;         // still being recorded
+} history_night;
+
+typedef struct history_index {
+  uint8_t version;
+  uint8_t newest;       // slot of the newest night
+  uint8_t num_nights;
+  history_night nights[HISTORY_NIGHTS];
+  uint8_t last_block[HISTORY_NIGHTS];
+} history_index;
+
+typedef void (*HistoryEpochHandler)(uint8_t epoch, void *context);
+
+// Encoding, one header byte per token. Tokens never straddle blocks.
+//   0xxxxxxx  one epoch, the zigzagged difference from the previous one
+//             when it is within -64..63
+//   10nnnnnn  n + 1 repeats of the previous epoch
+//   11nnnnnn  n + 1 epochs follow as raw bytes
+#define HISTORY_TOKEN_RUN       0x80
+#define HISTORY_TOKEN_RAW       0xc0
+#define HISTORY_TOKEN_KIND      0xc0
+#define HISTORY_TOKEN_COUNT     0x3f
+#define HISTORY_TOKEN_MAX       (HISTORY_TOKEN_COUNT + 1)
+
+// Stream the epochs of encoded history, oldest first, stopping after
+// num_epochs. value is the epoch before the first one and is left at the
+// last one decoded, so consecutive blocks can be decoded in turn. Returns
+// the number decoded.
+uint16_t history_decode_bytes(const uint8_t *data, uint16_t size, uint16_t num_epochs,
+                              uint8_t *value, HistoryEpochHandler handler,
+                              void *context);
@@ -1,76 +1,24 @@
 #include <pebble.h>
 #include "alarm.h"
+#include "latency.h"
+#include "sequence.h"
 
-#define ALARM_REPEAT              6
-#define ALARM_LIMIT               (ARRAY_LENGTH(alarm_pattern) * ALARM_REPEAT)
 #define SNOOZE_DURATION_SECONDS   9 * SECONDS_PER_MINUTE
-#define VIBE_DUR_MS               PBL_IF_ROUND_ELSE(100, 50)
-
-// Times (in seconds) between each vibe (gives a progressive alarm and gaps between phases)
-static uint8_t alarm_pattern[] = { 6, 5, 4, 4, 3, 3, 3, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 13 };
-
-// Pulse widths (in milliseconds) for each single vibe
-static uint32_t const single_segments[] = { VIBE_DUR_MS };
-static uint32_t const double_segments[] = { VIBE_DUR_MS, 100, VIBE_DUR_MS };
-static uint32_t const triple_segments[] = { VIBE_DUR_MS*2, 100, VIBE_DUR_MS*2, 100, VIBE_DUR_MS*2};
-VibePattern single_pat = {
-  .durations = single_segments,
-  .num_segments = ARRAY_LENGTH(single_segments),
-};
-VibePattern double_pat = {
-  .durations = double_segments,
-  .num_segments = ARRAY_LENGTH(double_segments),
-};
-VibePattern triple_pat = {
-  .durations = triple_segments,
-  .num_segments = ARRAY_LENGTH(triple_segments),
-};
-VibePattern *vibe_pattern[3] = {&single_pat, &double_pat, &triple_pat};
-
-static AppTimer *alarm_timer = NULL;
-uint8_t alarm_count = ALARM_LIMIT;
 
 Window *s_window;
 static ActionBarLayer *s_action_bar;
-static ActionMenuLevel *s_root_level;
+static ActionMenuLevel *s_root_level = NULL;
 static TextLayer *s_time_layer;
 static GBitmap *s_ellipsis_bitmap;
 
-// Alarm timer loop
+// Start the vibes
 void do_alarm(void *data) {
-  
-  if (data == NULL)
-    alarm_count = 0;
-  else
-    alarm_count = *(uint8_t *)data;
-  
-  if (alarm_count == 0)
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Alarm fired, starting vibes");
-  else
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Alarm count = %u", (unsigned int)alarm_count);
-
-  // Already hit the limit, give up
-  if (alarm_count >= ALARM_LIMIT) {
-    alarm_timer = NULL;    
-    return;
-  }
-  
-  // Vibrate
-  VibePattern pat = *vibe_pattern[(alarm_count / ARRAY_LENGTH(alarm_pattern)) % ARRAY_LENGTH(vibe_pattern)];
-  vibes_enqueue_custom_pattern(pat);
-  
-  // Prepare a timer for the next buzz
-  uint8_t delay = alarm_pattern[alarm_count % (ARRAY_LENGTH(alarm_pattern))];
-  alarm_count++;
-  alarm_timer = app_timer_register(((uint16_t)delay) * 1000, do_alarm, &alarm_count);
+  sequence_start();
 }
 
 static void do_snooze(void) {
   APP_LOG(APP_LOG_LEVEL_INFO, "Alarm snoozed");
-  if (alarm_timer != NULL) {
-    app_timer_cancel(alarm_timer);
-    alarm_timer = NULL;
-  }
+  sequence_stop();
   WakeupId id = wakeup_schedule(time(NULL) + SNOOZE_DURATION_SECONDS, 0, true);
   if (id < 0)
     APP_LOG(APP_LOG_LEVEL_ERROR, "Snooze failed");
@@ -80,8 +28,7 @@ static void do_snooze(void) {
 static void action_performed_callback(ActionMenu *action_menu, const ActionMenuItem *action, void *context) {
     
   // Cancel the current alarm, then create a wakeup event if snooze was selected
-  app_timer_cancel(alarm_timer);
-  alarm_timer = NULL;
+  sequence_stop();
   bool snooze = (bool)action_menu_item_get_action_data(action);
   if (snooze) {
     do_snooze();
@@ -96,6 +43,13 @@ static void action_performed_callback(ActionMenu *action_menu, const ActionMenuI
 
 // Callback for select button presses in the main window
 static void select_click_handler(ClickRecognizerRef recognizer, void *context) {
+  // Only built when asked for, so it stays off the alarm's launch path
+  if (s_root_level == NULL) {
+    s_root_level = action_menu_level_create(2);
+    action_menu_level_add_action(s_root_level, "Stop", action_performed_callback, (bool *)false);
+    action_menu_level_add_action(s_root_level, "Snooze", action_performed_callback, (bool *)true);
+  }
+
   // Configure the ActionMenu Window about to be shown
   ActionMenuConfig config = (ActionMenuConfig) {
     .root_level = s_root_level,
@@ -140,10 +94,13 @@ void alarm_window_unload(Window *window) {
   text_layer_destroy(s_time_layer);
   action_bar_layer_destroy(s_action_bar);
   gbitmap_destroy(s_ellipsis_bitmap);
-  action_menu_hierarchy_destroy(s_root_level, NULL, NULL);
+  if (s_root_level != NULL) {
+    action_menu_hierarchy_destroy(s_root_level, NULL, NULL);
+    s_root_level = NULL;
+  }
   
   // If there is an ongoing alarm and the window is closed, snooze the alarm
-  if (alarm_timer != NULL)
+  if (sequence_running())
     do_snooze();
 }
 
@@ -178,21 +135,23 @@ void alarm_window_load(Window *window) {
 
   update_time();
 
-  // Set up the actions menu
-  s_root_level = action_menu_level_create(2);
-  action_menu_level_add_action(s_root_level, "Stop", action_performed_callback, (bool *)false);
-  action_menu_level_add_action(s_root_level, "Snooze", action_performed_callback, (bool *)true);
-
   // Register with TickTimerService
   tick_timer_service_subscribe(MINUTE_UNIT, tick_handler);
   
 }
 
+// The window is on screen, the last step of the alarm's launch
+static void alarm_window_appear(Window *window) {
+  latency_mark(LATENCY_WINDOW);
+  latency_report();
+}
+
 void alarm_init(void) {
   s_window = window_create();
   window_set_background_color(s_window, PBL_IF_COLOR_ELSE(GColorOxfordBlue, GColorWhite));
   window_set_window_handlers(s_window, (WindowHandlers) {
     .load = alarm_window_load,
+    .appear = alarm_window_appear,
     .unload = alarm_window_unload,
   });
   window_stack_push(s_window, true);
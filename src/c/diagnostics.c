@@ -0,0 +1,181 @@
+#include <pebble.h>
+#include "diagnostics.h"
+#include "latency.h"
+#include "status.h"
+#include "store.h"
+
+#define DIAGNOSTICS_TEXT_HEIGHT   2000
+
+static const char *fire_names[] = { "none", "peak", "fallback" };
+static const char *detector_names[] = { "bins", "ema", "cole-kripke" };
+static const char *state_names[] = {
+  "idle", "pre-recording", "wakeup window", "fired"
+};
+
+static Window *s_diagnostics_window;
+static ScrollLayer *s_scroll_layer;
+static TextLayer *s_text_layer;
+static char s_text[896];
+
+static void format_stats(char *text, size_t size) {
+  worker_stats stats;
+  if (persist_read_data(STATS_KEY, &stats, sizeof(stats)) != sizeof(stats) ||
+      stats.version != STATS_VERSION) {
+    snprintf(text, size, "No worker stats yet");
+    return;
+  }
+
+  time_t start = stats.start_time;
+  char start_text[16];
+  strftime(start_text, sizeof(start_text), clock_is_24h_style() ? "%d %b %H:%M" :
+           "%d %b %I:%M", localtime(&start));
+  uint32_t batch_us = stats.batches ? stats.accel_ms * 1000 / stats.batches : 0;
+  uint32_t check_us = stats.peak_checks ? stats.peak_ms * 1000 / stats.peak_checks : 0;
+  snprintf(text, size,
+           "Night %s%s\n"
+           "Epochs %u (%u quiet)\n"
+           "  %u from Health\n"
+           "Accel on %lu:%02lu\n"
+           "Batches %lu\n"
+           "Samples %lu\n"
+           "Vibe drops %lu\n"
+           "Handler %lu ms\n"
+           "  %lu us/batch, max %u ms\n"
+           "Peak checks %lu\n"
+           "  %lu us/check\n"
+           "Detector %s\n"
+           "  %u Hz x%u, %u min bins\n"
+           "  %u min window, %u pre\n"
+           "Fired %s\n"
+           "Ring %u epochs",
+           start_text, stats.open ? " (open)" : "",
+           stats.epochs, stats.quiet_epochs,
+           stats.seeded_epochs,
+           (unsigned long)(stats.accel_seconds / SECONDS_PER_HOUR),
+           (unsigned long)(stats.accel_seconds / SECONDS_PER_MINUTE % 60),
+           (unsigned long)stats.batches,
+           (unsigned long)stats.samples,
+           (unsigned long)stats.vibe_samples,
+           (unsigned long)stats.accel_ms,
+           (unsigned long)batch_us, stats.accel_max_ms,
+           (unsigned long)stats.peak_checks,
+           (unsigned long)check_us,
+           stats.detector < ARRAY_LENGTH(detector_names) ?
+             detector_names[stats.detector] : "?",
+           stats.params.sample_rate, stats.params.batch_samples,
+           stats.params.bin_minutes, stats.params.buffer_minutes,
+           stats.params.pre_recording_minutes,
+           stats.fire < ARRAY_LENGTH(fire_names) ? fire_names[stats.fire] : "?",
+           stats.ring_fill);
+}
+
+// How long the newest alarm took to get going
+static void format_latency(char *text, size_t size) {
+  alarm_latency latency;
+  if (!latency_load(&latency))
+    return;
+  time_t at = latency.time;
+  char at_text[8];
+  strftime(at_text, sizeof(at_text), clock_is_24h_style() ? "%H:%M" : "%I:%M",
+           localtime(&at));
+  char fire_text[12] = "?";
+  if (latency.fire_ms >= 0)
+    snprintf(fire_text, sizeof(fire_text), "%ld", (long)latency.fire_ms);
+  snprintf(text, size,
+           "\n\nAlarm %s%s\n"
+           "  fired +%s ms\n"
+           "  vibe +%u ms\n"
+           "  window +%u ms",
+           at_text, latency.launched ? " (launched)" : "",
+           fire_text, latency.vibe_ms, latency.window_ms);
+}
+
+// The stored counters and the newest alarm's latency
+static void format_stored(char *text, size_t size) {
+  format_stats(text, size);
+  size_t n = strlen(text);
+  format_latency(text + n, size - n);
+}
+
+// The worker as it is now, above the stored counters
+static void format_status(const worker_status *status, char *text, size_t size) {
+  char next_text[8] = "-";
+  if (status->next_transition) {
+    time_t next = status->next_transition;
+    strftime(next_text, sizeof(next_text), clock_is_24h_style() ? "%H:%M" : "%I:%M",
+             localtime(&next));
+  }
+  int n = snprintf(text, size,
+                   "Now %s\n"
+                   "  until %s\n"
+                   "Ring %u epochs, last %u\n"
+                   "Epoch %u crossings\n"
+                   "  in %u samples\n"
+                   "Score %u%% (%s)\n"
+                   "Mean %u\n\n",
+                   status->state < ARRAY_LENGTH(state_names) ?
+                     state_names[status->state] : "?",
+                   next_text,
+                   status->ring_fill, status->last_epoch,
+                   status->count, status->samples,
+                   status->score,
+                   status->detector < ARRAY_LENGTH(detector_names) ?
+                     detector_names[status->detector] : "?",
+                   status->mean);
+  if (n > 0 && (size_t)n < size)
+    format_stored(text + n, size - n);
+}
+
+static void update_text(void) {
+  Layer *window_layer = window_get_root_layer(s_diagnostics_window);
+  GRect bounds = layer_get_bounds(window_layer);
+  text_layer_set_text(s_text_layer, s_text);
+  GSize size = text_layer_get_content_size(s_text_layer);
+  text_layer_set_size(s_text_layer, GSize(bounds.size.w - 10, size.h + 5));
+  scroll_layer_set_content_size(s_scroll_layer, GSize(bounds.size.w, size.h + 10));
+}
+
+static void status_received(const worker_status *status) {
+  format_status(status, s_text, sizeof(s_text));
+  update_text();
+}
+
+static void diagnostics_window_load(Window *window) {
+  Layer *window_layer = window_get_root_layer(window);
+  GRect bounds = layer_get_bounds(window_layer);
+
+  s_scroll_layer = scroll_layer_create(bounds);
+  scroll_layer_set_click_config_onto_window(s_scroll_layer, window);
+  layer_add_child(window_layer, scroll_layer_get_layer(s_scroll_layer));
+
+  format_stored(s_text, sizeof(s_text));
+  s_text_layer = text_layer_create(GRect(5, 0, bounds.size.w - 10, DIAGNOSTICS_TEXT_HEIGHT));
+  text_layer_set_background_color(s_text_layer, GColorClear);
+  text_layer_set_text_color(s_text_layer, GColorWhite);
+  text_layer_set_font(s_text_layer, fonts_get_system_font(FONT_KEY_GOTHIC_18));
+  scroll_layer_add_child(s_scroll_layer, text_layer_get_layer(s_text_layer));
+  update_text();
+
+  // The worker answers straight away if it is running
+  status_query(status_received);
+}
+
+static void diagnostics_window_unload(Window *window) {
+  status_cancel();
+  text_layer_destroy(s_text_layer);
+  scroll_layer_destroy(s_scroll_layer);
+  window_destroy(s_diagnostics_window);
+  s_diagnostics_window = NULL;
+}
+
+// Open the worker counters for the newest night. The window frees
+// everything when it is closed.
+void diagnostics_init(void) {
+  s_diagnostics_window = window_create();
+  window_set_background_color(s_diagnostics_window, GColorBlack);
+  window_set_window_handlers(s_diagnostics_window, (WindowHandlers) {
+    .load = diagnostics_window_load,
+    .unload = diagnostics_window_unload
+  });
+  window_stack_push(s_diagnostics_window, true);
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+void diagnostics_init(void);
@@ -0,0 +1,170 @@
+#include <pebble.h>
+#include "export.h"
+#include "nights.h"
+#include "params.h"
+
+#define EXPORT_CMD_START          1
+#define EXPORT_CHUNK_SIZE         200
+#define EXPORT_INBOX_SIZE         512  // the settings page comes in here too, alarms and all
+#define EXPORT_MAX_RETRIES        5
+#define EXPORT_RETRY_MS           100
+
+// The night being sent, exactly as the worker encoded it
+static uint8_t s_data[NIGHTS_MAX_BYTES];
+static uint16_t s_size;
+static uint32_t s_checksum;
+static history_night s_night;
+static uint8_t s_age;
+
+static bool s_active = false;
+static uint16_t s_offset;     // first byte not yet acknowledged
+static uint16_t s_in_flight;  // bytes in the outstanding message
+static uint8_t s_retries;
+static AppTimer *s_retry_timer = NULL;
+
+// Adler-32 of the encoded night, checked by the phone once reassembled
+static uint32_t checksum(const uint8_t *data, uint16_t size) {
+  uint32_t a = 1, b = 0;
+  for (uint16_t i = 0; i < size; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return (b << 16) | a;
+}
+
+// Read a night into s_data
+static bool load_night(uint8_t age) {
+  int size = nights_load(age, &s_night, s_data);
+  if (size < 0)
+    return false;
+  s_size = size;
+  s_checksum = checksum(s_data, s_size);
+  s_age = age;
+  return true;
+}
+
+static void retry_callback(void *data);
+
+static void schedule_retry(void) {
+  if (++s_retries > EXPORT_MAX_RETRIES) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Export stalled at %u/%u B", s_offset, s_size);
+    s_active = false;
+    return;
+  }
+  s_retry_timer = app_timer_register(EXPORT_RETRY_MS << (s_retries - 1), 
+                                     retry_callback, NULL);
+}
+
+// Send the next chunk. Every message carries the night header, so the 
+// phone can pick up from any offset.
+static void send_chunk(void) {
+  DictionaryIterator *iter;
+  if (app_message_outbox_begin(&iter) != APP_MSG_OK) {
+    schedule_retry();
+    return;
+  }
+  uint16_t n = s_size - s_offset;
+  if (n > EXPORT_CHUNK_SIZE)
+    n = EXPORT_CHUNK_SIZE;
+  DictionaryResult result = 
+    dict_write_uint8(iter, MESSAGE_KEY_ExportNight, s_age) |
+    dict_write_int32(iter, MESSAGE_KEY_ExportStartTime, s_night.start_time) |
+    dict_write_uint16(iter, MESSAGE_KEY_ExportEpochs, s_night.num_epochs) |
+    dict_write_uint16(iter, MESSAGE_KEY_ExportTotal, s_size) |
+    dict_write_uint32(iter, MESSAGE_KEY_ExportChecksum, s_checksum) |
+    dict_write_uint16(iter, MESSAGE_KEY_ExportOffset, s_offset) |
+    dict_write_data(iter, MESSAGE_KEY_ExportData, s_data + s_offset, n);
+  if (result != DICT_OK) {
+    // Retrying would only fail the same way
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Export chunk at %u does not fit (%d)", 
+            s_offset, (int)result);
+    s_active = false;
+    return;
+  }
+  if (app_message_outbox_send() != APP_MSG_OK) {
+    schedule_retry();
+    return;
+  }
+  s_in_flight = n;
+}
+
+static void retry_callback(void *data) {
+  s_retry_timer = NULL;
+  if (s_active)
+    send_chunk();
+}
+
+// Start (or resume) sending a night, 0 being the newest
+bool export_start(uint8_t age, uint16_t offset) {
+  if (s_retry_timer) {
+    app_timer_cancel(s_retry_timer);
+    s_retry_timer = NULL;
+  }
+  if (!load_night(age)) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "No night %u to export", age);
+    s_active = false;
+    return false;
+  }
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Exporting night %u from %u/%u B", 
+          age, offset, s_size);
+  s_offset = offset < s_size ? offset : s_size;
+  s_retries = 0;
+  s_active = true;
+  send_chunk();
+  return true;
+}
+
+// The next chunk goes out as soon as the last one is acknowledged
+static void outbox_sent_handler(DictionaryIterator *iter, void *context) {
+  if (!s_active)
+    return;
+  s_offset += s_in_flight;
+  s_in_flight = 0;
+  s_retries = 0;
+  if (s_offset < s_size) {
+    send_chunk();
+  } else {
+    APP_LOG(APP_LOG_LEVEL_INFO, "Exported night %u, %u B", s_age, s_size);
+    s_active = false;
+  }
+}
+
+static void outbox_failed_handler(DictionaryIterator *iter, 
+                                  AppMessageResult reason, void *context) {
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Export chunk at %u failed (%d)", 
+          s_offset, (int)reason);
+  s_in_flight = 0;
+  if (s_active)
+    schedule_retry();
+}
+
+static void inbox_received_handler(DictionaryIterator *iter, void *context) {
+  if (params_received(iter))
+    return;
+  Tuple *command = dict_find(iter, MESSAGE_KEY_ExportCommand);
+  if (command == NULL || command->value->uint8 != EXPORT_CMD_START)
+    return;
+  Tuple *night = dict_find(iter, MESSAGE_KEY_ExportNight);
+  Tuple *offset = dict_find(iter, MESSAGE_KEY_ExportOffset);
+  export_start(night ? night->value->uint8 : 0, 
+               offset ? offset->value->uint16 : 0);
+}
+
+void export_init(void) {
+  app_message_register_inbox_received(inbox_received_handler);
+  app_message_register_outbox_sent(outbox_sent_handler);
+  app_message_register_outbox_failed(outbox_failed_handler);
+  // Room for a full chunk with the header that goes with every one
+  uint32_t outbox_size = dict_calc_buffer_size(7, 
+    sizeof(uint8_t), sizeof(int32_t), sizeof(uint16_t), sizeof(uint16_t),
+    sizeof(uint32_t), sizeof(uint16_t), EXPORT_CHUNK_SIZE);
+  app_message_open(EXPORT_INBOX_SIZE, outbox_size);
+}
+
+void export_deinit(void) {
+  if (s_retry_timer) {
+    app_timer_cancel(s_retry_timer);
+    s_retry_timer = NULL;
+  }
+  s_active = false;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+void export_init(void);
+void export_deinit(void);
+bool export_start(uint8_t age, uint16_t offset);
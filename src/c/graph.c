@@ -0,0 +1,153 @@
+#include <pebble.h>
+#include "graph.h"
+#include "diagnostics.h"
+#include "nights.h"
+#include "pyramid.h"
+
+#define GRAPH_HEADER_HEIGHT   30
+
+static Window *s_graph_window;
+static TextLayer *s_header_layer;
+static Layer *s_graph_layer;
+
+static pyramid s_pyramid;
+static uint8_t s_level;       // pyramid level drawn, one node per column
+static uint8_t s_fit_level;   // level at which the whole night fits
+static uint16_t s_scroll;     // first node drawn
+
+static void append_epoch(uint8_t epoch, void *context) {
+  pyramid_append(&s_pyramid, epoch);
+}
+
+// Decode the newest night straight into the pyramid
+static bool load_graph(history_night *night) {
+  if (!pyramid_init(&s_pyramid))
+    return false;
+  uint8_t *data = malloc(NIGHTS_MAX_BYTES);
+  if (data == NULL)
+    return false;
+  int size = nights_load(0, night, data);
+  if (size > 0)
+    nights_decode(data, size, night->num_epochs, append_epoch, NULL);
+  free(data);
+  return size > 0;
+}
+
+// One vertical min-max line per column, whatever the zoom
+static void graph_update_proc(Layer *layer, GContext *ctx) {
+  GRect bounds = layer_get_bounds(layer);
+  uint16_t size = pyramid_size(&s_pyramid, s_level);
+  if (size == 0 || s_pyramid.peak == 0)
+    return;
+  int16_t h = bounds.size.h - 1;
+  graphics_context_set_stroke_color(ctx, PBL_IF_COLOR_ELSE(GColorCyan, GColorWhite));
+  for (int16_t x = 0; x < bounds.size.w && s_scroll + x < size; x++) {
+    uint8_t min, max;
+    pyramid_get(&s_pyramid, s_level, s_scroll + x, &min, &max);
+    int16_t top = h - (max * h) / s_pyramid.peak;
+    int16_t bottom = h - (min * h) / s_pyramid.peak;
+    graphics_draw_line(ctx, GPoint(x, top), GPoint(x, bottom));
+  }
+}
+
+static void scroll_by(int16_t delta) {
+  int16_t width = layer_get_bounds(s_graph_layer).size.w;
+  int16_t last = pyramid_size(&s_pyramid, s_level) - width;
+  int16_t scroll = s_scroll + delta;
+  if (scroll > last)
+    scroll = last;
+  if (scroll < 0)
+    scroll = 0;
+  s_scroll = scroll;
+  layer_mark_dirty(s_graph_layer);
+}
+
+static void up_click_handler(ClickRecognizerRef recognizer, void *context) {
+  scroll_by(-layer_get_bounds(s_graph_layer).size.w / 2);
+}
+
+static void down_click_handler(ClickRecognizerRef recognizer, void *context) {
+  scroll_by(layer_get_bounds(s_graph_layer).size.w / 2);
+}
+
+// Select zooms in a level at a time, then back out to the whole night,
+// keeping the first column's time in place
+static void select_click_handler(ClickRecognizerRef recognizer, void *context) {
+  uint32_t first_epoch = (uint32_t)s_scroll << s_level;
+  s_level = s_level == 0 ? s_fit_level : s_level - 1;
+  s_scroll = first_epoch >> s_level;
+  scroll_by(0);
+}
+
+// Long select shows the worker's counters for the night
+static void select_long_click_handler(ClickRecognizerRef recognizer, void *context) {
+  diagnostics_init();
+}
+
+static void click_config_provider(void *context) {
+  window_single_click_subscribe(BUTTON_ID_UP, up_click_handler);
+  window_single_click_subscribe(BUTTON_ID_DOWN, down_click_handler);
+  window_single_click_subscribe(BUTTON_ID_SELECT, select_click_handler);
+  window_long_click_subscribe(BUTTON_ID_SELECT, 0, select_long_click_handler, NULL);
+}
+
+static void graph_window_load(Window *window) {
+  Layer *window_layer = window_get_root_layer(window);
+  GRect bounds = layer_get_bounds(window_layer);
+
+  s_header_layer = text_layer_create(GRect(bounds.origin.x + 5, bounds.origin.y, 
+                                           bounds.size.w - 10, GRAPH_HEADER_HEIGHT));
+  text_layer_set_background_color(s_header_layer, GColorClear);
+  text_layer_set_text_color(s_header_layer, GColorWhite);
+  text_layer_set_font(s_header_layer, fonts_get_system_font(FONT_KEY_GOTHIC_18_BOLD));
+  text_layer_set_text_alignment(s_header_layer, GTextAlignmentCenter);
+  layer_add_child(window_layer, text_layer_get_layer(s_header_layer));
+
+  s_graph_layer = layer_create(GRect(bounds.origin.x, bounds.origin.y + GRAPH_HEADER_HEIGHT,
+                                     bounds.size.w, bounds.size.h - GRAPH_HEADER_HEIGHT));
+  layer_set_update_proc(s_graph_layer, graph_update_proc);
+  layer_add_child(window_layer, s_graph_layer);
+
+  static char s_header[24];
+  history_night night;
+  if (load_graph(&night)) {
+    time_t start = night.start_time;
+    char start_text[8];
+    strftime(start_text, sizeof(start_text), clock_is_24h_style() ? "%H:%M" : "%I:%M", 
+             localtime(&start));
+    snprintf(s_header, sizeof(s_header), "%s  %u:%02u", start_text, 
+             night.num_epochs / 60, night.num_epochs % 60);
+  } else {
+    snprintf(s_header, sizeof(s_header), "No nights recorded");
+  }
+  text_layer_set_text(s_header_layer, s_header);
+
+  // Start zoomed out to the whole night
+  s_fit_level = 0;
+  while (s_fit_level < PYRAMID_LEVELS - 1 && 
+         pyramid_size(&s_pyramid, s_fit_level) > bounds.size.w)
+    s_fit_level++;
+  s_level = s_fit_level;
+  s_scroll = 0;
+}
+
+static void graph_window_unload(Window *window) {
+  pyramid_free(&s_pyramid);
+  layer_destroy(s_graph_layer);
+  text_layer_destroy(s_header_layer);
+  window_destroy(s_graph_window);
+  s_graph_window = NULL;
+}
+
+// Open the graph of the newest night. The window frees everything when it
+// is closed.
+void graph_init(void) {
+  s_graph_window = window_create();
+  window_set_background_color(s_graph_window, GColorBlack);
+  window_set_window_handlers(s_graph_window, (WindowHandlers) {
+    .load = graph_window_load,
+    .unload = graph_window_unload
+  });
+  window_set_click_config_provider(s_graph_window, click_config_provider);
+  window_stack_push(s_graph_window, true);
+}
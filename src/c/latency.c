@@ -0,0 +1,78 @@
+#include <pebble.h>
+#include "latency.h"
+#include "store.h"
+
+#define LATENCY_KEY           311
+#define LATENCY_VERSION       1
+
+// An older fire stamp belongs to an earlier alarm, as when a snooze or
+// the backstop wakeup starts the app
+#define FIRE_STAMP_MAX_MS     (60 * 1000)
+
+typedef struct stamp {
+  time_t seconds;
+  uint16_t ms;
+} stamp;
+
+static stamp s_marks[LATENCY_MARKS];
+static uint8_t s_marked;
+static bool s_launched;
+
+static int32_t ms_between(time_t from_seconds, uint16_t from_ms,
+                          time_t to_seconds, uint16_t to_ms) {
+  return (int32_t)(to_seconds - from_seconds) * 1000 + to_ms - from_ms;
+}
+
+static uint16_t ms_since_start(LatencyMark mark) {
+  int32_t ms = ms_between(s_marks[LATENCY_START].seconds, s_marks[LATENCY_START].ms,
+                          s_marks[mark].seconds, s_marks[mark].ms);
+  return ms < 0 ? 0 : ms > UINT16_MAX ? UINT16_MAX : ms;
+}
+
+void latency_start(bool launched) {
+  s_marked = 0;
+  s_launched = launched;
+  latency_mark(LATENCY_START);
+}
+
+// Only the first time each point is reached after the start counts
+void latency_mark(LatencyMark mark) {
+  if (s_marked & (1 << mark))
+    return;
+  if (mark != LATENCY_START && !(s_marked & (1 << LATENCY_START)))
+    return;
+  time_ms(&s_marks[mark].seconds, &s_marks[mark].ms);
+  s_marked |= 1 << mark;
+}
+
+// Once every point has been reached, log the alarm's latency and keep it
+void latency_report(void) {
+  if (s_marked != (1 << LATENCY_MARKS) - 1)
+    return;
+  s_marked = 0;
+
+  alarm_latency latency = {
+    .version = LATENCY_VERSION,
+    .launched = s_launched,
+    .time = s_marks[LATENCY_START].seconds,
+    .fire_ms = -1,
+    .vibe_ms = ms_since_start(LATENCY_VIBE),
+    .window_ms = ms_since_start(LATENCY_WINDOW),
+  };
+  fire_stamp fired;
+  if (persist_read_data(FIRE_STAMP_KEY, &fired, sizeof(fired)) == sizeof(fired)) {
+    int32_t ms = ms_between(fired.seconds, fired.ms, s_marks[LATENCY_START].seconds,
+                            s_marks[LATENCY_START].ms);
+    if (ms >= 0 && ms <= FIRE_STAMP_MAX_MS)
+      latency.fire_ms = ms;
+  }
+
+  APP_LOG(APP_LOG_LEVEL_INFO, "Alarm latency: fired +%ld ms, vibe +%u ms, window +%u ms",
+          (long)latency.fire_ms, latency.vibe_ms, latency.window_ms);
+  persist_write_data(LATENCY_KEY, &latency, sizeof(latency));
+}
+
+bool latency_load(alarm_latency *latency) {
+  return persist_read_data(LATENCY_KEY, latency, sizeof(*latency)) == sizeof(*latency) &&
+         latency->version == LATENCY_VERSION;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <pebble.h>
+
+// Timestamps along the alarm's path, from the worker firing to the first
+// vibe and the alarm window, so the latency is measured on the watch
+// rather than assumed. The newest alarm's numbers are kept for the
+// diagnostics window.
+
+typedef enum {
+  LATENCY_START,      // the app took the alarm
+  LATENCY_VIBE,       // first vibe handed to the firmware
+  LATENCY_WINDOW,     // alarm window on screen
+  LATENCY_MARKS,
+} LatencyMark;
+
+typedef struct alarm_latency {
+  uint8_t version;
+  uint8_t launched;   // the app was started for the alarm
+  int32_t time;       // when the app took it
+  int32_t fire_ms;    // from the worker firing to the app taking it, -1 if unknown
+  uint16_t vibe_ms;   // from the app taking it to the first vibe
+  uint16_t window_ms; // and to the alarm window
+} alarm_latency;
+
+void latency_start(bool launched);
+void latency_mark(LatencyMark mark);
+void latency_report(void);
+bool latency_load(alarm_latency *latency);
@@ -1,34 +1,51 @@
 #include <pebble.h>
 #include "alarm.h"
+#include "export.h"
+#include "latency.h"
+#include "protocol.h"
 #include "settings.h"
+#include "status.h"
 #include "ui.h"
 
 #define WAKEUP_HOUR     8
 #define WAKEUP_MINUTE   15
 
-#define SENDER_WORKER   0
-#define SENDER_APP      1
-
 bool did_alarm_init = false;
 
-// Close the worker and start the alarm sequence
-static void alarm_trigger(void) {
+// Tonight's alarm is done, move the backstop on to the next one
+static void alarm_advance(void *data) {
+  if (get_alarm_state())
+    schedule_alarm_wakeup(current_alarm_time(time(NULL)));
+}
+
+// Start the alarm sequence before anything else, then push the alarm
+// window before init returns, since the firmware closes an app that has
+// no window on its stack. The window's layers are built in its load
+// handler and the wakeup is left to the event loop.
+static void alarm_trigger(bool launched) {
+  latency_start(launched);
+  do_alarm(0);
+  latency_mark(LATENCY_VIBE);
   if (!did_alarm_init) {
     alarm_init();
     did_alarm_init = true;
   }
-  do_alarm(0);
+  app_timer_register(0, alarm_advance, NULL);
 }
 
-// Handle when the worker sends a message (alarm trigger)
+// Handle when the worker sends a message (alarm trigger or status reply)
 static void worker_message_handler(uint16_t type, AppWorkerMessage *message) {
-  if (type == SENDER_WORKER)
-    alarm_trigger();
+  if (type != PROTOCOL_SENDER_WORKER)
+    return;
+  if (protocol_command(message) == PROTOCOL_ALARM_FIRED)
+    alarm_trigger(false);
+  else
+    status_handle_message(message);
 }
 
 // Handle when a wakeup is received (alarm trigger)
 static void wakeup_handler(WakeupId id, int32_t reason) {
-  alarm_trigger();
+  alarm_trigger(false);
 }
 
 static void handle_init(void) {
@@ -36,7 +53,7 @@ static void handle_init(void) {
   // Trigger the alarm immediately if the worker or wakeup woke us up
   if (launch_reason() == APP_LAUNCH_WORKER || 
      launch_reason() == APP_LAUNCH_WAKEUP) {
-    alarm_trigger();
+    alarm_trigger(true);
   } else {
   
     // Save the default alarm time
@@ -45,6 +62,9 @@ static void handle_init(void) {
     
     // Open the UI
     ui_init();
+    
+    // Let the phone fetch recorded nights
+    export_init();
   
     // Subscribe to alarm trigger messages
     app_worker_message_subscribe(worker_message_handler);
@@ -57,11 +77,14 @@ static void handle_init(void) {
 }
 
 static void handle_deinit(void) {
+  settings_flush();
   if (did_alarm_init)
     alarm_deinit();
   if (launch_reason() != APP_LAUNCH_WORKER &&
-     launch_reason() != APP_LAUNCH_WAKEUP)
+     launch_reason() != APP_LAUNCH_WAKEUP) {
+    export_deinit();
     ui_deinit();
+  }
 }
 
 int main(void) {
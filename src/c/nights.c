@@ -0,0 +1,33 @@
+#include <pebble.h>
+#include "nights.h"
+
+// Read a night's encoded epochs (at most NIGHTS_MAX_BYTES) into data, 
+// 0 being the newest night. Returns the encoded size, or -1 if there is
+// no such night.
+int nights_load(uint8_t age, history_night *night, uint8_t *data) {
+  history_index index;
+  if (persist_read_data(HISTORY_INDEX_KEY, &index, sizeof(index)) != 
+      sizeof(index) || index.version != HISTORY_VERSION || 
+      age >= index.num_nights)
+    return -1;
+  uint8_t slot = (index.newest + HISTORY_NIGHTS - age) % HISTORY_NIGHTS;
+  *night = index.nights[slot];
+  uint16_t size = 0;
+  for (uint8_t b = 0; b <= index.last_block[slot] && b < HISTORY_BLOCKS; b++) {
+    int n = persist_read_data(HISTORY_BLOCK_KEY(slot, b), 
+                              data + size, HISTORY_BLOCK_SIZE);
+    if (n > 0)
+      size += n;
+  }
+  if (size > night->num_bytes)
+    size = night->num_bytes;
+  return size;
+}
+
+// Stream the epochs of an encoded night, oldest first. Returns the number
+// decoded.
+uint16_t nights_decode(const uint8_t *data, uint16_t size, uint16_t num_epochs,
+                       HistoryEpochHandler handler, void *context) {
+  uint8_t value = 0;
+  return history_decode_bytes(data, size, num_epochs, &value, handler, context);
+}
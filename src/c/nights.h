@@ -0,0 +1,12 @@
+#pragma once
+#include <pebble.h>
+#include "store.h"
+
+// Read access to the night history the worker keeps in persist storage
+// (worker_src/c/history.c), laid out in shared/store.h
+
+#define NIGHTS_MAX_BYTES    (HISTORY_BLOCKS * HISTORY_BLOCK_SIZE)
+
+int nights_load(uint8_t age, history_night *night, uint8_t *data);
+uint16_t nights_decode(const uint8_t *data, uint16_t size, uint16_t num_epochs,
+                       HistoryEpochHandler handler, void *context);
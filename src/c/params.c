@@ -0,0 +1,115 @@
+#include <pebble.h>
+#include "params.h"
+#include "protocol.h"
+#include "settings.h"
+
+// The stored parameters, or the worker's defaults if there are none
+void params_get(recording_params *params) {
+  if (persist_read_data(PARAMS_KEY, params, sizeof(*params)) != sizeof(*params) ||
+      params->version != PARAMS_VERSION)
+    *params = PARAMS_DEFAULTS;
+}
+
+// Select boxes on the page send strings, sliders send numbers
+static bool tuple_int(DictionaryIterator *iter, uint32_t key, int32_t *value) {
+  Tuple *t = dict_find(iter, key);
+  if (t == NULL)
+    return false;
+  if (t->type == TUPLE_CSTRING)
+    *value = atoi(t->value->cstring);
+  else if (t->length == 1)
+    *value = t->type == TUPLE_INT ? t->value->int8 : t->value->uint8;
+  else if (t->length == 2)
+    *value = t->type == TUPLE_INT ? t->value->int16 : t->value->uint16;
+  else
+    *value = t->value->int32;
+  return true;
+}
+
+// The settings page's controls for each alarm: its time, as "HH:MM", a
+// flag for each weekday from Sunday, and its window. The first alarm's
+// time is set with the buttons on the watch, so the page leaves it out.
+static const uint32_t s_alarm_time_keys[ALARM_SLOTS] = {
+  0, MESSAGE_KEY_AlarmTime1, MESSAGE_KEY_AlarmTime2, MESSAGE_KEY_AlarmTime3,
+};
+static const uint32_t s_alarm_days_keys[ALARM_SLOTS] = {
+  MESSAGE_KEY_AlarmDays0, MESSAGE_KEY_AlarmDays1, MESSAGE_KEY_AlarmDays2,
+  MESSAGE_KEY_AlarmDays3,
+};
+
+// Take the alarms the page sends, through the settings cache so the worker
+// and the backstop hear of them. Returns whether there were any.
+static bool alarms_received(DictionaryIterator *iter) {
+  bool any = false;
+  for (uint8_t slot = 0; slot < ALARM_SLOTS; slot++) {
+    alarm_slot alarm;
+    get_alarm_slot(slot, &alarm);
+    bool changed = false;
+    Tuple *t = s_alarm_time_keys[slot] ? dict_find(iter, s_alarm_time_keys[slot]) : NULL;
+    const char *colon = t && t->type == TUPLE_CSTRING ? strchr(t->value->cstring, ':') : NULL;
+    if (colon) {
+      int hour = atoi(t->value->cstring);
+      int minute = atoi(colon + 1);
+      if (hour >= 0 && hour < 24 && minute >= 0 && minute < 60) {
+        alarm.hour = hour;
+        alarm.minute = minute;
+        changed = true;
+      }
+    }
+    int32_t value;
+    for (uint8_t day = 0; day < 7; day++) {
+      if (tuple_int(iter, s_alarm_days_keys[slot] + day, &value)) {
+        alarm.days = value ? alarm.days | (1 << day) : alarm.days & ~(1 << day);
+        changed = true;
+      }
+    }
+    if (tuple_int(iter, MESSAGE_KEY_AlarmWindow + slot, &value) &&
+        value >= 0 && value <= UINT8_MAX) {
+      alarm.window_minutes = value;
+      changed = true;
+    }
+    if (changed)
+      set_alarm_slot(slot, &alarm);
+    any = any || changed;
+  }
+  return any;
+}
+
+// Take the settings page's values if this message carries them, store
+// them and have the worker pick them up. Returns whether it did.
+bool params_received(DictionaryIterator *iter) {
+  bool alarms = alarms_received(iter);
+  recording_params params;
+  params_get(&params);
+  int32_t value;
+  bool any = false;
+  if (tuple_int(iter, MESSAGE_KEY_SampleRate, &value)) {
+    params.sample_rate = value;
+    any = true;
+  }
+  if (tuple_int(iter, MESSAGE_KEY_BatchSamples, &value)) {
+    params.batch_samples = value;
+    any = true;
+  }
+  if (tuple_int(iter, MESSAGE_KEY_BufferMinutes, &value)) {
+    params.buffer_minutes = value;
+    any = true;
+  }
+  if (tuple_int(iter, MESSAGE_KEY_BinMinutes, &value)) {
+    params.bin_minutes = value;
+    any = true;
+  }
+  if (tuple_int(iter, MESSAGE_KEY_PreRecordMinutes, &value)) {
+    params.pre_recording_minutes = value;
+    any = true;
+  }
+  if (tuple_int(iter, MESSAGE_KEY_Detector, &value)) {
+    set_detector(value);
+    any = true;
+  }
+  if (!any)
+    return alarms;
+  persist_write_data(PARAMS_KEY, &params, sizeof(params));
+  protocol_send(PROTOCOL_PARAMS, protocol_next_seq(), 0, 0);
+  return true;
+}
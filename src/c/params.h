@@ -0,0 +1,10 @@
+#pragma once
+#include <pebble.h>
+#include "store.h"
+
+// Recording parameters from the settings page, laid out in
+// shared/store.h. The app only stores what the page sends and tells
+// the worker; the worker checks the ranges and takes them up live.
+
+void params_get(recording_params *params);
+bool params_received(DictionaryIterator *iter);
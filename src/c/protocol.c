@@ -0,0 +1,21 @@
+#include <pebble.h>
+#include "protocol.h"
+
+static uint8_t s_seq = 0;
+
+// 0 is left for the worker's own messages
+uint8_t protocol_next_seq(void) {
+  if (++s_seq == 0)
+    s_seq = 1;
+  return s_seq;
+}
+
+void protocol_send(ProtocolCommand command, uint8_t seq, uint16_t data1,
+                   uint16_t data2) {
+  AppWorkerMessage message = {
+    .data0 = (uint16_t)(seq << 8) | command,
+    .data1 = data1,
+    .data2 = data2,
+  };
+  app_worker_send_message(PROTOCOL_SENDER_APP, &message);
+}
@@ -0,0 +1,67 @@
+#include <pebble.h>
+#include "pyramid.h"
+
+#define PYRAMID_NODES       (2 * PYRAMID_MAX_EPOCHS - 1)
+
+_Static_assert(PYRAMID_MAX_EPOCHS >= HISTORY_MAX_EPOCHS, "pyramid too small for a night");
+
+// Offset of each level in the min/max arrays, the sum of the sizes of
+// the levels below it
+static inline uint16_t level_offset(uint8_t level) {
+  return 2 * (PYRAMID_MAX_EPOCHS - (PYRAMID_MAX_EPOCHS >> level));
+}
+
+bool pyramid_init(pyramid *p) {
+  p->count = 0;
+  p->peak = 0;
+  p->min = malloc(2 * PYRAMID_NODES);
+  if (p->min == NULL) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Memory allocation failed");
+    p->max = NULL;
+    return false;
+  }
+  p->max = p->min + PYRAMID_NODES;
+  return true;
+}
+
+void pyramid_free(pyramid *p) {
+  free(p->min);
+  p->min = NULL;
+  p->max = NULL;
+  p->count = 0;
+}
+
+// Add the next epoch, folding it into one node per level
+void pyramid_append(pyramid *p, uint8_t epoch) {
+  if (p->min == NULL || p->count >= PYRAMID_MAX_EPOCHS)
+    return;
+  uint16_t n = p->count++;
+  uint16_t offset = 0;
+  for (uint8_t k = 0; k < PYRAMID_LEVELS; k++) {
+    uint16_t node = offset + (n >> k);
+    if ((n & ((1 << k) - 1)) == 0) {
+      p->min[node] = epoch;
+      p->max[node] = epoch;
+    } else {
+      if (epoch < p->min[node])
+        p->min[node] = epoch;
+      if (epoch > p->max[node])
+        p->max[node] = epoch;
+    }
+    offset += PYRAMID_MAX_EPOCHS >> k;
+  }
+  if (epoch > p->peak)
+    p->peak = epoch;
+}
+
+// Number of (possibly partial) nodes in a level
+uint16_t pyramid_size(const pyramid *p, uint8_t level) {
+  return (p->count + (1 << level) - 1) >> level;
+}
+
+void pyramid_get(const pyramid *p, uint8_t level, uint16_t index, 
+                 uint8_t *min, uint8_t *max) {
+  uint16_t node = level_offset(level) + index;
+  *min = p->min[node];
+  *max = p->max[node];
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <pebble.h>
+#include "store.h"
+
+// Min/max pyramid over a night's epochs. Level k summarises runs of 2^k
+// epochs and is kept up to date as epochs are appended, so any zoom level
+// can be drawn without touching the raw data.
+
+// Enough levels for the longest night history.c keeps, pre-recording
+// and window together (HISTORY_MAX_EPOCHS)
+#define PYRAMID_LEVELS      11
+#define PYRAMID_MAX_EPOCHS  (1 << (PYRAMID_LEVELS - 1))
+
+typedef struct pyramid {
+  uint8_t *min;       // all levels back to back, level 0 first
+  uint8_t *max;
+  uint16_t count;     // epochs appended
+  uint8_t peak;       // largest epoch overall
+} pyramid;
+
+bool pyramid_init(pyramid *p);
+void pyramid_free(pyramid *p);
+void pyramid_append(pyramid *p, uint8_t epoch);
+uint16_t pyramid_size(const pyramid *p, uint8_t level);
+void pyramid_get(const pyramid *p, uint8_t level, uint16_t index, 
+                 uint8_t *min, uint8_t *max);
@@ -0,0 +1,185 @@
+#include <pebble.h>
+#include "sequence.h"
+
+#define ALARM_REPEAT              6
+#define VIBE_DUR_MS               PBL_IF_ROUND_ELSE(100, 50)
+
+// Times (in seconds) between each vibe (gives a progressive alarm and gaps between phases)
+static uint8_t alarm_pattern[] = { 6, 5, 4, 4, 3, 3, 3, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 13 };
+
+// Pulse widths (in milliseconds) for each single vibe
+static uint32_t const single_segments[] = { VIBE_DUR_MS };
+static uint32_t const double_segments[] = { VIBE_DUR_MS, 100, VIBE_DUR_MS };
+static uint32_t const triple_segments[] = { VIBE_DUR_MS*2, 100, VIBE_DUR_MS*2, 100, VIBE_DUR_MS*2};
+static VibePattern const single_pat = {
+  .durations = single_segments,
+  .num_segments = ARRAY_LENGTH(single_segments),
+};
+static VibePattern const double_pat = {
+  .durations = double_segments,
+  .num_segments = ARRAY_LENGTH(double_segments),
+};
+static VibePattern const triple_pat = {
+  .durations = triple_segments,
+  .num_segments = ARRAY_LENGTH(triple_segments),
+};
+static VibePattern const *vibe_pattern[3] = {&single_pat, &double_pat, &triple_pat};
+
+// The pulses repeat after every pattern has had a turn
+#define CYCLE_PULSES    (ARRAY_LENGTH(alarm_pattern) * ARRAY_LENGTH(vibe_pattern))
+#define CYCLE_REPEAT    (ALARM_REPEAT / ARRAY_LENGTH(vibe_pattern))
+
+typedef struct burst {
+  uint16_t first;           // first duration in s_durations
+  uint8_t num_segments;
+  uint32_t next_ms;         // from this burst to the next
+} burst;
+
+static uint32_t *s_durations = NULL;
+static burst *s_bursts = NULL;
+static uint16_t s_num_bursts;
+static uint16_t s_step;
+static AppTimer *s_timer = NULL;
+
+void sequence_pulse(uint16_t count, VibePattern *pattern, uint8_t *delay) {
+  *pattern = *vibe_pattern[(count / ARRAY_LENGTH(alarm_pattern)) % ARRAY_LENGTH(vibe_pattern)];
+  *delay = alarm_pattern[count % ARRAY_LENGTH(alarm_pattern)];
+}
+
+uint16_t sequence_pulses(void) {
+  return ARRAY_LENGTH(alarm_pattern) * ALARM_REPEAT;
+}
+
+static uint32_t pattern_ms(const VibePattern *pattern) {
+  uint32_t ms = 0;
+  for (uint32_t i = 0; i < pattern->num_segments; i++)
+    ms += pattern->durations[i];
+  return ms;
+}
+
+// Lay one cycle of pulses out as the vibe queue would play them: a pulse
+// sent while the previous one is still going follows it straight on, so
+// the two on segments merge. A burst is closed when the next pulse would
+// take it over the limits. With durations and bursts NULL this only
+// counts, so the storage can be sized first.
+static void compose(uint32_t *durations, burst *bursts,
+                    uint16_t *num_durations, uint16_t *num_bursts) {
+  uint16_t used = 0;
+  uint16_t count = 0;
+  uint16_t first = 0;
+  uint32_t sent = 0;        // when the pulse is sent, from the burst start
+  uint32_t end = 0;         // when the burst's vibes stop
+  for (uint16_t i = 0; i < CYCLE_PULSES; i++) {
+    VibePattern pattern;
+    uint8_t delay;
+    sequence_pulse(i, &pattern, &delay);
+    uint32_t gap = sent > end ? sent - end : 0;
+    uint32_t segments = used - first + pattern.num_segments + (gap ? 1 : -1);
+    uint32_t ms = (sent > end ? sent : end) + pattern_ms(&pattern);
+    if (used > first && (segments > SEQUENCE_MAX_SEGMENTS || ms > SEQUENCE_MAX_MS)) {
+      if (bursts)
+        bursts[count] = (burst) { first, used - first, sent };
+      count++;
+      first = used;
+      sent = end = gap = 0;
+    }
+    uint32_t const *segment = pattern.durations;
+    if (used > first && gap) {
+      if (durations)
+        durations[used] = gap;
+      used++;
+    } else if (used > first) {
+      if (durations)
+        durations[used - 1] += *segment;
+      segment++;
+    }
+    for (; segment < pattern.durations + pattern.num_segments; segment++) {
+      if (durations)
+        durations[used] = *segment;
+      used++;
+    }
+    end = (sent > end ? sent : end) + pattern_ms(&pattern);
+    sent += delay * 1000;
+  }
+  if (bursts)
+    bursts[count] = (burst) { first, used - first, sent };
+  *num_durations = used;
+  *num_bursts = count + 1;
+}
+
+static void play_step(void *data) {
+  s_timer = NULL;
+  uint16_t total = s_num_bursts * CYCLE_REPEAT;
+  if (s_step >= total) {
+    sequence_stop();
+    return;
+  }
+  burst *b = &s_bursts[s_step % s_num_bursts];
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Alarm burst %u of %u", (unsigned int)s_step + 1,
+          (unsigned int)total);
+  vibes_enqueue_custom_pattern((VibePattern) {
+    .durations = &s_durations[b->first],
+    .num_segments = b->num_segments,
+  });
+  s_step++;
+  s_timer = app_timer_register(b->next_ms, play_step, NULL);
+}
+
+// Without room for the composed cycle, the pulses go one at a time with
+// a timer after each, as the alarm did before it was composed
+static void play_pulse(void *data) {
+  s_timer = NULL;
+  if (s_step >= sequence_pulses()) {
+    sequence_stop();
+    return;
+  }
+  VibePattern pattern;
+  uint8_t delay;
+  sequence_pulse(s_step, &pattern, &delay);
+  vibes_enqueue_custom_pattern(pattern);
+  s_step++;
+  s_timer = app_timer_register((uint32_t)delay * 1000, play_pulse, NULL);
+}
+
+// Compose the cycle and play its first burst, or play pulse by pulse if
+// the cycle can't be allocated. Returns whether it was composed; the
+// alarm plays either way.
+bool sequence_start(void) {
+  sequence_stop();
+  s_step = 0;
+  uint16_t num_durations;
+  compose(NULL, NULL, &num_durations, &s_num_bursts);
+  s_durations = malloc(num_durations * sizeof(uint32_t));
+  s_bursts = malloc(s_num_bursts * sizeof(burst));
+  if (s_durations == NULL || s_bursts == NULL) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "No memory to compose the alarm, playing it pulse by pulse");
+    free(s_durations);
+    free(s_bursts);
+    s_durations = NULL;
+    s_bursts = NULL;
+    play_pulse(NULL);
+    return false;
+  }
+  compose(s_durations, s_bursts, &num_durations, &s_num_bursts);
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Alarm fired, %u pulses in %u bursts",
+          (unsigned int)sequence_pulses(), (unsigned int)(s_num_bursts * CYCLE_REPEAT));
+  play_step(NULL);
+  return true;
+}
+
+// Silence the alarm, including what is left of the current burst
+void sequence_stop(void) {
+  if (s_timer != NULL) {
+    app_timer_cancel(s_timer);
+    s_timer = NULL;
+    vibes_cancel();
+  }
+  free(s_durations);
+  free(s_bursts);
+  s_durations = NULL;
+  s_bursts = NULL;
+}
+
+bool sequence_running(void) {
+  return s_timer != NULL;
+}
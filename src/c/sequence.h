@@ -0,0 +1,19 @@
+#pragma once
+#include <pebble.h>
+
+// The progressive alarm's vibes. The pulses of one cycle are composed
+// into a few long multi-segment patterns when the alarm starts, and a
+// timer is only registered between those, instead of after every pulse.
+
+// Limits on one composed pattern, inside what the firmware plays as one
+#define SEQUENCE_MAX_SEGMENTS   32
+#define SEQUENCE_MAX_MS         10000
+
+bool sequence_start(void);
+void sequence_stop(void);
+bool sequence_running(void);
+
+// One pulse of the plain alarm: the pattern for pulse count and the
+// seconds until the next one
+void sequence_pulse(uint16_t count, VibePattern *pattern, uint8_t *delay);
+uint16_t sequence_pulses(void);
@@ -1,16 +1,159 @@
 #include <pebble.h>
 #include "settings.h"
+#include "protocol.h"
 
-#define ALARM_HOUR_KEY     0
-#define ALARM_MINUTE_KEY   1
 #define ALARM_ON_KEY       2
+#define ALARM_WAKEUP_KEY   3
+#define DETECTOR_KEY       4
 
-#define SENDER_WORKER      0
-#define SENDER_APP         1
+// The wakeup backstop rings shortly after the alarm time, in case the
+// worker isn't running to do it
+#define BACKSTOP_DELAY_SECONDS  SECONDS_PER_MINUTE
 
-AppWorkerMessage message = {
-  .data0 = true
-};
+// Alarm changes are written to flash and sent to the worker once they've
+// stopped changing for this long
+#define SETTINGS_COMMIT_MS 1000
+
+// Cached alarms, with a bit set for each one not yet committed
+static alarm_slot s_slots[ALARM_SLOTS];
+static bool s_slots_loaded = false;
+static uint8_t s_dirty_slots = 0;
+static AppTimer *s_commit_timer = NULL;
+static schedule_table s_schedule;  // the same table the worker builds
+
+static void load_slots(void) {
+  if (s_slots_loaded)
+    return;
+  s_slots_loaded = true;
+  if (persist_read_data(ALARMS_KEY, s_slots, sizeof(s_slots)) != sizeof(s_slots)) {
+  
+    // Carry the single daily alarm over from older versions
+    memset(s_slots, 0, sizeof(s_slots));
+    if (persist_exists(ALARM_HOUR_KEY) && persist_exists(ALARM_MINUTE_KEY)) {
+      s_slots[0] = (alarm_slot) {
+        .hour = persist_read_int(ALARM_HOUR_KEY),
+        .minute = persist_read_int(ALARM_MINUTE_KEY),
+        .days = ALARM_EVERY_DAY,
+        .window_minutes = DEFAULT_WINDOW_MINUTES,
+      };
+    }
+  }
+  schedule_compile(s_slots, &s_schedule);
+}
+
+// First alarm after the given time, from the compiled table
+static bool next_fire(time_t after, time_t *fire, uint16_t *window) {
+  load_slots();
+  if (s_schedule.num_entries == 0)
+    return false;
+  for (int week = 0; week < 2; week++) {
+    for (int i = 0; i < s_schedule.num_entries; i++) {
+      schedule_entry *entry = &s_schedule.entries[i];
+      time_t fire_time = schedule_entry_time(after, entry->minute_of_week, week);
+      if (fire_time > after) {
+        *fire = fire_time;
+        *window = entry->window_minutes * SECONDS_PER_MINUTE;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Pass a changed alarm to the worker, so it doesn't have to read flash
+static void send_slot(uint8_t slot) {
+  alarm_slot *alarm = &s_slots[slot];
+  protocol_send(PROTOCOL_ALARM_SLOT, protocol_next_seq(),
+                (slot << PROTOCOL_SLOT_SHIFT) | (alarm->hour * 60 + alarm->minute),
+                (alarm->window_minutes << PROTOCOL_WINDOW_SHIFT) | alarm->days);
+}
+
+// Where the backstop goes from now. An alarm whose window is open keeps
+// its backstop until the worker has fired it, so opening the app after an
+// early wake doesn't ring the same alarm again a minute after its time.
+static time_t backstop_after(time_t now) {
+  time_t alarm_time;
+  uint16_t window;
+  if (!next_fire(now - BACKSTOP_DELAY_SECONDS - 1, &alarm_time, &window) ||
+      alarm_time - window > now)
+    return now;
+  fire_stamp fired;
+  if (persist_read_data(FIRE_STAMP_KEY, &fired, sizeof(fired)) == sizeof(fired) &&
+      fired.seconds >= alarm_time - window && fired.seconds <= alarm_time)
+    return alarm_time;
+  return alarm_time - 1;
+}
+
+// Write the changed alarms in one go, then let the worker and the
+// backstop know. A worker that isn't running yet, because no alarm rang
+// on any day before, reads them when it starts.
+static void commit_slots(void *data) {
+  s_commit_timer = NULL;
+  if (s_dirty_slots == 0)
+    return;
+  persist_write_data(ALARMS_KEY, s_slots, sizeof(s_slots));
+  for (uint8_t slot = 0; slot < ALARM_SLOTS; slot++) {
+    if (s_dirty_slots & (1 << slot))
+      send_slot(slot);
+  }
+  s_dirty_slots = 0;
+  if (!get_alarm_state())
+    return;
+  if (s_schedule.num_entries > 0 && !app_worker_is_running())
+    app_worker_launch();
+  schedule_alarm_wakeup(backstop_after(time(NULL)));
+}
+
+// Hold a change back until the alarms stop changing
+static void save_slot(uint8_t slot) {
+  s_dirty_slots |= 1 << slot;
+  schedule_compile(s_slots, &s_schedule);
+  if (s_commit_timer == NULL || !app_timer_reschedule(s_commit_timer, SETTINGS_COMMIT_MS))
+    s_commit_timer = app_timer_register(SETTINGS_COMMIT_MS, commit_slots, NULL);
+}
+
+// Commit any held back changes now
+void settings_flush(void) {
+  if (s_commit_timer) {
+    app_timer_cancel(s_commit_timer);
+    s_commit_timer = NULL;
+  }
+  commit_slots(NULL);
+}
+
+// Cancel the backstop wakeup, if one is scheduled
+static void cancel_alarm_wakeup(void) {
+  if (persist_exists(ALARM_WAKEUP_KEY)) {
+    wakeup_cancel(persist_read_int(ALARM_WAKEUP_KEY));
+    persist_delete(ALARM_WAKEUP_KEY);
+  }
+}
+
+// Schedule the backstop wakeup for the first alarm time after the given time
+void schedule_alarm_wakeup(time_t after) {
+  cancel_alarm_wakeup();
+  time_t alarm_time;
+  uint16_t window;
+  if (!next_fire(after, &alarm_time, &window))
+    return;
+  WakeupId id = wakeup_schedule(alarm_time + BACKSTOP_DELAY_SECONDS, 0, true);
+  if (id < 0) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Backstop wakeup failed");
+    return;
+  }
+  persist_write_int(ALARM_WAKEUP_KEY, id);
+}
+
+// The alarm that is ringing now: its window has opened and its backstop
+// hasn't passed. Otherwise just now.
+time_t current_alarm_time(time_t now) {
+  time_t alarm_time;
+  uint16_t window;
+  if (next_fire(now - BACKSTOP_DELAY_SECONDS - 1, &alarm_time, &window) &&
+      alarm_time - window <= now)
+    return alarm_time;
+  return now;
+}
 
 // Save the state (ON or OFF) to persistent storage
 void set_alarm_state(bool state) {
@@ -24,13 +167,19 @@ void set_alarm_state(bool state) {
     set_alarm_time(hour, minute);
   }
   
-  // Turn on or off the worker
-  if (state && !app_worker_is_running()) {
+  // Turn on or off the worker, which is only needed while some alarm
+  // rings on some day. It reads the alarms from flash when it starts.
+  settings_flush();
+  load_slots();
+  if (state && s_schedule.num_entries > 0 && !app_worker_is_running()) {
     app_worker_launch();
   } else if (!state) {
     app_worker_kill();
     wakeup_cancel_all();
+    persist_delete(ALARM_WAKEUP_KEY);
   }
+  if (state)
+    schedule_alarm_wakeup(backstop_after(time(NULL)));
 }
 
 // Read the state (ON or OFF)
@@ -41,26 +190,50 @@ bool get_alarm_state(void) {
     return false;
 }
 
-// Save the hour and minute to persistent storage
+// Read one of the alarms
+bool get_alarm_slot(uint8_t slot, alarm_slot *alarm) {
+  if (slot >= ALARM_SLOTS)
+    return false;
+  load_slots();
+  *alarm = s_slots[slot];
+  return true;
+}
+
+// Change one of the alarms. An alarm with no days set is off.
+void set_alarm_slot(uint8_t slot, const alarm_slot *alarm) {
+  if (slot >= ALARM_SLOTS)
+    return;
+  load_slots();
+  s_slots[slot] = *alarm;
+  save_slot(slot);
+}
+
+// Save the hour and minute of the first alarm, which rings every day 
+// unless it has been given days of its own
 void set_alarm_time(uint32_t hour, uint32_t minute) {
-  persist_write_int(ALARM_HOUR_KEY, hour);
-  persist_write_int(ALARM_MINUTE_KEY, minute);
-  
-  // Send message to background worker to update time
-  app_worker_send_message(SENDER_APP, &message);
+  load_slots();
+  alarm_slot *alarm = &s_slots[0];
+  alarm->hour = hour;
+  alarm->minute = minute;
+  if (alarm->days == 0) {
+    alarm->days = ALARM_EVERY_DAY;
+    alarm->window_minutes = DEFAULT_WINDOW_MINUTES;
+  }
+  save_slot(0);
 }
 
-// Check whether alarm time exists
+// Check whether the first alarm is set
 bool alarm_time_exists(void) {
-  return persist_exists(ALARM_HOUR_KEY) && persist_exists(ALARM_MINUTE_KEY);
+  load_slots();
+  return s_slots[0].days != 0;
 }
 
-// Read the hour and minute from storage
+// Read the hour and minute of the first alarm
 bool get_alarm_time(uint32_t *hour, uint32_t *minute) {
   if (!alarm_time_exists())
     return false;
-  *hour = persist_read_int(ALARM_HOUR_KEY);
-  *minute = persist_read_int(ALARM_MINUTE_KEY);
+  *hour = s_slots[0].hour;
+  *minute = s_slots[0].minute;
   return true;
 }
 
@@ -77,8 +250,15 @@ void change_alarm_time(uint32_t *hour, uint32_t *minute, int32_t delta_minutes)
   set_alarm_time(*hour, *minute);
 }
 
-// Delete the alarm time
+// Delete the first alarm
 void delete_alarm_time(void) {
-  persist_delete(ALARM_HOUR_KEY);
-  persist_delete(ALARM_MINUTE_KEY);
+  load_slots();
+  s_slots[0].days = 0;
+  save_slot(0);
+}
+
+// Save which wake detector the worker uses. It takes effect the next time
+// the worker starts recording, or straight away on PROTOCOL_PARAMS.
+void set_detector(uint32_t detector) {
+  persist_write_int(DETECTOR_KEY, detector);
 }
@@ -1,4 +1,6 @@
 #pragma once
+#include <pebble.h>
+#include "store.h"
 
 void set_alarm_state(bool state);
 bool get_alarm_state(void);
@@ -6,4 +8,10 @@ void set_alarm_time(uint32_t hour, uint32_t minute);
 bool alarm_time_exists(void);
 bool get_alarm_time(uint32_t *hour, uint32_t *minute);
 void change_alarm_time(uint32_t *hour, uint32_t *minute, int32_t delta_minutes);
-void delete_alarm_time(void);
\ No newline at end of file
+void delete_alarm_time(void);
+bool get_alarm_slot(uint8_t slot, alarm_slot *alarm);
+void set_alarm_slot(uint8_t slot, const alarm_slot *alarm);
+void schedule_alarm_wakeup(time_t after);
+time_t current_alarm_time(time_t now);
+void settings_flush(void);
+void set_detector(uint32_t detector);
@@ -0,0 +1,58 @@
+#include <pebble.h>
+#include "status.h"
+#include "protocol.h"
+
+static StatusCallback s_callback = NULL;
+static uint8_t s_seq;
+static worker_status s_status;
+
+// Ask the worker how it is doing. The callback gets the answer once its
+// last part arrives; a newer query replaces an older one.
+bool status_query(StatusCallback callback) {
+  if (!app_worker_is_running())
+    return false;
+  s_callback = callback;
+  memset(&s_status, 0, sizeof(s_status));
+  s_seq = protocol_next_seq();
+  protocol_send(PROTOCOL_QUERY_STATUS, s_seq, 0, 0);
+  return true;
+}
+
+void status_cancel(void) {
+  s_callback = NULL;
+}
+
+// Take one part of a status reply from the worker. Parts answering an
+// older query are dropped. Returns whether the message was a status part.
+bool status_handle_message(const AppWorkerMessage *message) {
+  ProtocolCommand command = protocol_command(message);
+  if (command < PROTOCOL_STATUS_RECORDING || command > PROTOCOL_STATUS_NEXT)
+    return false;
+  if (s_callback == NULL || protocol_seq(message) != s_seq)
+    return true;
+  switch (command) {
+    case PROTOCOL_STATUS_RECORDING:
+      s_status.ring_fill = message->data1;
+      s_status.state = (WorkerState)(message->data2 >> PROTOCOL_STATE_SHIFT);
+      s_status.detector = (message->data2 >> PROTOCOL_DETECTOR_SHIFT) &
+                          ((1 << (PROTOCOL_STATE_SHIFT - PROTOCOL_DETECTOR_SHIFT)) - 1);
+      s_status.last_epoch = message->data2 & ((1 << PROTOCOL_DETECTOR_SHIFT) - 1);
+      break;
+    case PROTOCOL_STATUS_EPOCH:
+      s_status.count = message->data1;
+      s_status.samples = message->data2;
+      break;
+    case PROTOCOL_STATUS_SCORE:
+      s_status.score = message->data1;
+      s_status.mean = message->data2;
+      break;
+    default: {
+      s_status.next_transition = (time_t)(((uint32_t)message->data1 << 16) | message->data2);
+      StatusCallback callback = s_callback;
+      s_callback = NULL;
+      callback(&s_status);
+      break;
+    }
+  }
+  return true;
+}
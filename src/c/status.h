@@ -0,0 +1,31 @@
+#pragma once
+#include <pebble.h>
+
+// Live worker state, asked for over the worker message protocol
+// (protocol.h) and answered from the worker's memory, so nothing goes
+// through flash.
+
+typedef enum {
+  WORKER_IDLE,
+  WORKER_PRE_RECORDING,
+  WORKER_WAKEUP_WINDOW,
+  WORKER_FIRED,
+} WorkerState;
+
+typedef struct worker_status {
+  WorkerState state;
+  uint8_t detector;         // DetectorType, see worker_src/c/detector.h
+  uint16_t ring_fill;       // epochs in the worker's ring
+  uint8_t last_epoch;       // newest closed epoch
+  uint16_t count;           // crossings in the open epoch
+  uint16_t samples;         // samples in the open epoch
+  uint16_t score;           // percent of the detector's peak threshold
+  uint16_t mean;            // mean epoch over the ring
+  time_t next_transition;   // 0 without an alarm
+} worker_status;
+
+typedef void (*StatusCallback)(const worker_status *status);
+
+bool status_query(StatusCallback callback);
+void status_cancel(void);
+bool status_handle_message(const AppWorkerMessage *message);
@@ -1,6 +1,7 @@
 #include <pebble.h>
 #include "ui.h"
 #include "settings.h"
+#include "graph.h"
 
 #define TIME_CHANGE_RESOLUTION        5
 #define TIME_CHANGE_REPEAT_DURATION   50
@@ -63,6 +64,11 @@ static void select_click_handler(ClickRecognizerRef recognizer, void *context) {
   display_default(state);
 }
 
+// Long select clicks show last night's sleep graph
+static void select_long_click_handler(ClickRecognizerRef recognizer, void *context) {
+  graph_init();
+}
+
 // Subcribe to button click events
 static void click_config_provider(void *context) {
   window_single_repeating_click_subscribe(BUTTON_ID_UP, TIME_CHANGE_REPEAT_DURATION,
@@ -70,6 +76,7 @@ static void click_config_provider(void *context) {
   window_single_repeating_click_subscribe(BUTTON_ID_DOWN, TIME_CHANGE_REPEAT_DURATION,
                                           down_click_handler);
   window_single_click_subscribe(BUTTON_ID_SELECT, select_click_handler);
+  window_long_click_subscribe(BUTTON_ID_SELECT, 0, select_long_click_handler, NULL);
 }
 
 // Load the main display
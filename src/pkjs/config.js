@@ -0,0 +1,154 @@
+// Settings page. Values go to the watch under the message keys in
+// package.json; the app stores them as the alarms and the recording
+// parameters (src/c/params.c) and the worker takes them up without
+// restarting. The ranges and defaults follow worker_src/c/params.c, which
+// checks them again.
+
+var DAYS = ["Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"];
+
+// One alarm slot (shared/store.h). The first one's time is set on the
+// watch and it rings every day to begin with; the others start off.
+function alarm(slot) {
+  var items = [
+    {
+      "type": "heading",
+      "size": 4,
+      "defaultValue": "Alarm " + (slot + 1)
+    }
+  ];
+  if (slot > 0) {
+    items.push({
+      "type": "input",
+      "messageKey": "AlarmTime" + slot,
+      "label": "Time",
+      "defaultValue": "07:00",
+      "attributes": { "type": "time" }
+    });
+  }
+  items.push({
+    "type": "checkboxgroup",
+    "messageKey": "AlarmDays" + slot,
+    "label": slot > 0 ? "Days" : "Days (the time is set on the watch)",
+    "defaultValue": DAYS.map(function() { return slot === 0; }),
+    "options": DAYS
+  });
+  items.push({
+    "type": "slider",
+    "messageKey": "AlarmWindow[" + slot + "]",
+    "label": "Wake window (minutes)",
+    "description": "How early the alarm may ring on a light phase of sleep.",
+    "defaultValue": 30,
+    "min": 0,
+    "max": 90,
+    "step": 5
+  });
+  return items;
+}
+
+module.exports = [
+  {
+    "type": "heading",
+    "defaultValue": "Sense Alarm"
+  },
+  {
+    "type": "text",
+    "defaultValue": "Faster sampling and longer recording cost battery. Changes apply to tonight's recording straight away."
+  },
+  {
+    "type": "section",
+    "items": [
+      {
+        "type": "heading",
+        "defaultValue": "Alarms"
+      },
+      {
+        "type": "text",
+        "defaultValue": "An alarm with no days ticked is off."
+      }
+    ].concat(alarm(0), alarm(1), alarm(2), alarm(3))
+  },
+  {
+    "type": "section",
+    "items": [
+      {
+        "type": "heading",
+        "defaultValue": "Detection"
+      },
+      {
+        "type": "select",
+        "messageKey": "Detector",
+        "label": "Wake detector",
+        "defaultValue": "0",
+        "options": [
+          { "label": "Bins", "value": "0" },
+          { "label": "Moving averages", "value": "1" },
+          { "label": "Cole-Kripke", "value": "2" }
+        ]
+      },
+      {
+        "type": "slider",
+        "messageKey": "BufferMinutes",
+        "label": "Analysis window (minutes)",
+        "description": "How far back the detector looks. Two hours at least, so the sleep cycle can be found; keep it within the pre-recording time.",
+        "defaultValue": 120,
+        "min": 120,
+        "max": 240,
+        "step": 15
+      },
+      {
+        "type": "slider",
+        "messageKey": "BinMinutes",
+        "label": "Bin length (minutes)",
+        "description": "Used by the bins detector. Shorter bins react sooner but are noisier.",
+        "defaultValue": 10,
+        "min": 5,
+        "max": 20,
+        "step": 1
+      }
+    ]
+  },
+  {
+    "type": "section",
+    "items": [
+      {
+        "type": "heading",
+        "defaultValue": "Battery"
+      },
+      {
+        "type": "select",
+        "messageKey": "SampleRate",
+        "label": "Sample rate",
+        "defaultValue": "10",
+        "options": [
+          { "label": "10 Hz", "value": "10" },
+          { "label": "25 Hz", "value": "25" },
+          { "label": "50 Hz", "value": "50" }
+        ]
+      },
+      {
+        "type": "slider",
+        "messageKey": "BatchSamples",
+        "label": "Samples per wakeup",
+        "description": "Fewer samples per batch wake the watch more often.",
+        "defaultValue": 25,
+        "min": 5,
+        "max": 25,
+        "step": 5
+      },
+      {
+        "type": "slider",
+        "messageKey": "PreRecordMinutes",
+        "label": "Pre-recording (minutes)",
+        "description": "How long before the wakeup window recording starts. Watches with Health fill most of it from Health's history.",
+        "defaultValue": 240,
+        "min": 30,
+        "max": 480,
+        "step": 30
+      }
+    ]
+  },
+  {
+    "type": "submit",
+    "defaultValue": "Save"
+  }
+];
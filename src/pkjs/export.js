@@ -0,0 +1,115 @@
+// Fetches recorded nights from the watch. The watch streams a night's
+// encoded epoch counts in chunks; each chunk carries its offset so a
+// dropped connection resumes where it stopped.
+
+var EXPORT_CMD_START = 1;
+var EXPORT_STALL_MS = 5000;
+var EXPORT_MAX_RESUMES = 5;
+
+var transfer = null;
+
+function adler32(bytes) {
+  var a = 1, b = 0;
+  for (var i = 0; i < bytes.length; i++) {
+    a = (a + bytes[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return ((b << 16) | a) >>> 0;
+}
+
+// Inverse of the worker's history encoding (shared/store.h): one header
+// byte per token, a small delta, a run of repeats or a group of raw bytes
+function decodeNight(bytes, numEpochs) {
+  var epochs = [];
+  var value = 0;
+  var i = 0;
+  while (i < bytes.length && epochs.length < numEpochs) {
+    var token = bytes[i++];
+    var count = (token & 0x3f) + 1;
+    if (!(token & 0x80)) {
+      var delta = (token & 1) ? -((token + 1) >> 1) : token >> 1;
+      value = (value + delta) & 0xff;
+      epochs.push(value);
+    } else if ((token & 0xc0) === 0x80) {
+      for (; count > 0 && epochs.length < numEpochs; count--)
+        epochs.push(value);
+    } else {
+      for (; count > 0 && i < bytes.length && epochs.length < numEpochs; count--) {
+        value = bytes[i++];
+        epochs.push(value);
+      }
+    }
+  }
+  return epochs;
+}
+
+function requestNight(night, offset) {
+  Pebble.sendAppMessage({
+    'ExportCommand': EXPORT_CMD_START,
+    'ExportNight': night,
+    'ExportOffset': offset
+  }, null, function() {
+    console.log('Export request for night ' + night + ' failed');
+  });
+}
+
+// Ask again from the last byte received if the watch goes quiet
+function armStallTimer() {
+  clearTimeout(transfer.timer);
+  transfer.timer = setTimeout(function() {
+    if (!transfer || transfer.resumes++ >= EXPORT_MAX_RESUMES) {
+      transfer = null;
+      return;
+    }
+    requestNight(transfer.night, transfer.bytes.length);
+    armStallTimer();
+  }, EXPORT_STALL_MS);
+}
+
+function startExport(night) {
+  transfer = { night: night, bytes: [], resumes: 0, timer: null };
+  requestNight(night, 0);
+  armStallTimer();
+}
+
+function finishExport(p) {
+  clearTimeout(transfer.timer);
+  var bytes = transfer.bytes;
+  transfer = null;
+  if (adler32(bytes) !== (p.ExportChecksum >>> 0)) {
+    console.log('Export checksum mismatch, retrying');
+    startExport(p.ExportNight);
+    return;
+  }
+  var epochs = decodeNight(bytes, p.ExportEpochs);
+  var key = 'night-' + p.ExportStartTime;
+  localStorage.setItem(key, JSON.stringify({
+    start: p.ExportStartTime,
+    epochs: epochs
+  }));
+  localStorage.setItem('last-export', String(p.ExportStartTime));
+  console.log('Exported ' + epochs.length + ' epochs (' + bytes.length + ' B)');
+}
+
+Pebble.addEventListener('appmessage', function(e) {
+  var p = e.payload;
+  if (!transfer || p.ExportData === undefined || p.ExportNight !== transfer.night)
+    return;
+
+  // Only take the chunk that continues what we have; anything else means
+  // a chunk went missing, so resume from our offset
+  if (p.ExportOffset !== transfer.bytes.length) {
+    if (p.ExportOffset > transfer.bytes.length)
+      requestNight(transfer.night, transfer.bytes.length);
+    return;
+  }
+  transfer.bytes = transfer.bytes.concat(p.ExportData);
+  armStallTimer();
+  if (transfer.bytes.length >= p.ExportTotal)
+    finishExport(p);
+});
+
+// Fetch the latest night whenever the app opens
+Pebble.addEventListener('ready', function() {
+  startExport(0);
+});
@@ -0,0 +1,9 @@
+// Phone side of the app: the settings page, and fetching recorded nights
+// (export.js)
+
+var Clay = require('pebble-clay');
+var clayConfig = require('./config');
+
+var clay = new Clay(clayConfig);
+
+require('./export');
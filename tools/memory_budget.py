@@ -0,0 +1,168 @@
+#!/usr/bin/env python
+"""Memory budget of a linked Pebble binary, from its linker map.
+
+Adds up the output sections into text (code and read-only data), data and
+bss, and takes what is left of the memory as heap. The linker script gives
+every binary the app's region, so a binary that gets less, as the worker
+does, has its own size in the limits. The wscript runs this after every
+app and worker link and fails the build when a limit in MEMORY_BUDGET is
+exceeded, or when there is no map to check; it can also be run by hand:
+
+    python tools/memory_budget.py build/pebble-worker.map --memory 10752 --min-heap 2048
+"""
+
+from __future__ import print_function
+
+import argparse
+import re
+import sys
+from collections import defaultdict
+
+SECTION = re.compile(r'^(\.[\w.-]+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s*(\S*)')
+REGION = re.compile(r'^(\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)')
+
+DATA_SECTIONS = ('.data', '.got', '.got.plt', '.igot.plt')
+BSS_SECTIONS = ('.bss',)
+NON_ALLOC_PREFIXES = ('.debug', '.comment', '.ARM.attributes', '.stab')
+
+
+def _sections(lines):
+    """Yield (name, address, size, file, top_level) for every section line,
+    joining names the linker wrapped onto their own line."""
+    pending = None
+    for line in lines:
+        line = line.rstrip('\n')
+        top_level = not line.startswith(' ')
+        stripped = line.strip()
+        if pending is not None:
+            match = SECTION.match(' ' + stripped)
+            pending_name, pending_top = pending
+            pending = None
+            if match and match.group(1) is None:
+                yield (pending_name, int(match.group(2), 16),
+                       int(match.group(3), 16), match.group(4), pending_top)
+            continue
+        if re.match(r'^\.[\w.-]+$', stripped) and (top_level or line.startswith(' .')):
+            pending = (stripped, top_level)
+            continue
+        if not (top_level and line.startswith('.')) and not line.startswith(' .') \
+                and not line.startswith(' COMMON'):
+            continue
+        parts = stripped.split()
+        if len(parts) < 3 or not parts[1].startswith('0x'):
+            continue
+        try:
+            address, size = int(parts[1], 16), int(parts[2], 16)
+        except ValueError:
+            continue
+        yield (parts[0], address, size, parts[3] if len(parts) > 3 else '',
+               top_level)
+
+
+def parse(path, memory=None):
+    """Totals of the map at path, with the heap taken from memory bytes if
+    given, or else from the map's memory region"""
+    with open(path) as f:
+        lines = f.readlines()
+
+    region = None
+    try:
+        start = next(i for i, l in enumerate(lines) if l.startswith('Memory Configuration'))
+        for line in lines[start + 1:]:
+            match = REGION.match(line)
+            if match and match.group(1) not in ('Name', '*default*'):
+                region = (match.group(1), int(match.group(3), 16))
+                break
+            if line.startswith('Linker script'):
+                break
+        body = next(i for i, l in enumerate(lines) if l.startswith('Linker script and memory map'))
+    except StopIteration:
+        raise ValueError('%s does not look like a linker map' % path)
+
+    totals = {'text': 0, 'data': 0, 'bss': 0}
+    objects = defaultdict(int)
+    end = 0
+    section = None
+    for name, address, size, filename, top_level in _sections(lines[body:]):
+        if top_level:
+            section = name
+            if name.startswith(NON_ALLOC_PREFIXES):
+                continue
+            if name in BSS_SECTIONS:
+                totals['bss'] += size
+            elif name in DATA_SECTIONS:
+                totals['data'] += size
+            else:
+                totals['text'] += size
+            if size:
+                end = max(end, address + size)
+        elif section in DATA_SECTIONS + BSS_SECTIONS and filename and size:
+            objects[filename.split('/')[-1]] += size
+
+    if memory is not None:
+        region = ('limit', memory)
+    return {
+        'region': region,
+        'totals': totals,
+        'end': end,
+        'heap': region[1] - end if region else None,
+        'objects': objects,
+    }
+
+
+def report(name, platform, budget, limits):
+    """Text report and a list of the limits that were exceeded"""
+    t = budget['totals']
+    static = t['text'] + t['data'] + t['bss']
+    lines = ['%s (%s)' % (name, platform),
+             '  text   %6d B' % t['text'],
+             '  data   %6d B' % t['data'],
+             '  bss    %6d B' % t['bss']]
+    if budget['region']:
+        lines.append('  heap   %6d B of %d B %s' % (budget['heap'], budget['region'][1],
+                                                  budget['region'][0]))
+    largest = sorted(budget['objects'].items(), key=lambda item: -item[1])[:5]
+    if largest:
+        lines.append('  largest data + bss: ' +
+                     ', '.join('%s %d B' % item for item in largest))
+
+    errors = []
+    max_static = limits.get('max_static')
+    if max_static is not None and static > max_static:
+        errors.append('%s %s: text + data + bss %d B is over the %d B limit' %
+                      (name, platform, static, max_static))
+    max_bss = limits.get('max_bss')
+    if max_bss is not None and t['bss'] > max_bss:
+        errors.append('%s %s: bss %d B is over the %d B limit' %
+                      (name, platform, t['bss'], max_bss))
+    min_heap = limits.get('min_heap')
+    if min_heap is not None and budget['heap'] is not None and budget['heap'] < min_heap:
+        errors.append('%s %s: %d B of heap left, %d B needed' %
+                      (name, platform, budget['heap'], min_heap))
+    return '\n'.join(lines), errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('map')
+    parser.add_argument('--name', default='binary')
+    parser.add_argument('--platform', default='?')
+    parser.add_argument('--memory', type=int,
+                        help='bytes the binary gets, if less than the map\'s region')
+    parser.add_argument('--max-static', type=int)
+    parser.add_argument('--max-bss', type=int)
+    parser.add_argument('--min-heap', type=int)
+    args = parser.parse_args()
+    text, errors = report(args.name, args.platform, parse(args.map, args.memory), {
+        'max_static': args.max_static,
+        'max_bss': args.max_bss,
+        'min_heap': args.min_heap,
+    })
+    print(text)
+    for error in errors:
+        print('error: ' + error, file=sys.stderr)
+    return 1 if errors else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -1,131 +1,182 @@
 #include <pebble_worker.h>
-#include "math.h"
 #include "accel.h"
 #include "datastore.h"
+#include "arena.h"
+#include "backfill.h"
+#include "baseline.h"
+#include "history.h"
+#include "detector.h"
+#include "stats.h"
+#include "kernel.h"
+#include "params.h"
 
-#define SAMPLE_RATE           10
-#define SAMPLES_PER_BATCH     25
-#define SECONDS_PER_EPOCH     SECONDS_PER_MINUTE
-#define SECONDS_PER_BIN       10 * SECONDS_PER_MINUTE
-#define SECONDS_IN_BUFFER     2 * SECONDS_PER_HOUR
+// Sample rate and batch size come from the settings (params.h); an epoch
+// is however many samples a minute holds at the rate it was sampled at.
+// Counts are scaled to a minute at 10 Hz whatever the rate, so history,
+// the baseline and the Health backfill scale don't depend on it.
+#define SAMPLES_PER_EPOCH     (SECONDS_PER_EPOCH * epoch_rate)
+#define SCALE_SAMPLES         (SECONDS_PER_EPOCH * 10)
 
-#define SAMPLES_PER_EPOCH     SECONDS_PER_EPOCH * SAMPLE_RATE
-#define EPOCHS_PER_BIN        SECONDS_PER_BIN / SECONDS_PER_EPOCH
-#define EPOCHS_IN_BUFFER      SECONDS_IN_BUFFER / SECONDS_PER_EPOCH
+// Adaptive sampling: after QUIET_EPOCHS epochs at or below the buffer mean
+// (or QUIET_COUNT crossings, whichever is higher), only the first 
+// QUIET_SAMPLES of each minute are sampled and the count is scaled up to a
+// full epoch
+#define QUIET_EPOCHS          5
+#define QUIET_COUNT           2
+#define QUIET_SAMPLES         (15 * epoch_rate)
+
+// Checkpoint of the epoch ring in persist storage, so a restarted worker
+// doesn't have to wait hours for a full buffer again
+#define CHECKPOINT_KEY        100
+#define CHECKPOINT_DATA_KEY   101
+#define CHECKPOINT_VERSION    2
+#define CHECKPOINT_EPOCHS     10
+#define CHECKPOINT_MAX_AGE    (15 * SECONDS_PER_MINUTE)
+
+// Detector chosen in the app settings
+#define DETECTOR_KEY          4
 
 #define DEBUG 0
 
 uint16_t count = 0;
 uint16_t samples_counted = 0;
-static circular_buffer buf;
+static epoch_ring buf;
+static uint8_t epochs_since_checkpoint = 0;
+static uint16_t live_epochs = 0;
+
+static bool quiet_mode = false;
+static bool accel_subscribed = false;
+static time_t subscribed_time;
+static AccelRate sampling = ACCEL_RATE_ADAPTIVE;
+static uint8_t epoch_rate = 10;     // Hz the open epoch is sampled at
+static uint8_t batch_samples;       // per callback while subscribed
+
+typedef struct checkpoint_header {
+  uint8_t version;
+  uint8_t sample_rate;    // of the partial epoch
+  int32_t timestamp;
+  uint16_t num_epochs;
+  uint16_t count;
+  uint16_t samples_counted;
+} checkpoint_header;
 #if DEBUG
 static DataLoggingSessionRef s_session_ref;
 static DataLoggingSessionRef l_session_ref;
 #endif
 
-// Count zero-crossings in accelerometer data batches
-static void accel_data_handler(AccelData *data, uint32_t num_samples) {
-
-  // Average the data
-  int16_t x, y, z, x_prev = 0, y_prev = 0, z_prev = 0;
-  float l;
-  AccelData *dx = data;
-  for (uint32_t i = 0; i < num_samples; i++, dx++) {
-    // If vibe went off then discount everything
-    if (dx->did_vibrate) {
-      APP_LOG(APP_LOG_LEVEL_DEBUG, "Vibrate invalidated datapoint");
-      continue;
-    }
-    samples_counted++;
-    x = dx->x;
-    y = dx->y;
-    z = dx->z;
-    l = sm_sqrt(x*x + y*y + z*z);
-    x -= (x/l)*1000;
-    y -= (y/l)*1000;
-    z -= (z/l)*1000;
-    if ((x > 0 && x_prev < 0) || (x < 0 && x_prev > 0) ||
-        (y > 0 && y_prev < 0) || (y < 0 && y_prev > 0) ||
-        (z > 0 && z_prev < 0) || (z < 0 && z_prev > 0)) {
-      count++;
-    }
-    x_prev = x;
-    y_prev = y;
-    z_prev = z;
-  }
-  
-  // Append the datastore if necessary
-  if (samples_counted >= SAMPLES_PER_EPOCH) {
-    count = count > 255 ? 255 : count;
-    cb_push_back(&buf, &count);
-#if DEBUG  
-    data_logging_log(s_session_ref, &count, 1);
-#endif
-    count = 0;
-    samples_counted = 0;
-  }
+// Append an epoch, letting the cycle estimator and the detector see it
+// first
+static void push_epoch(uint8_t epoch) {
+  cycle_push(&buf, epoch);
+  detector_push(&buf, epoch);
+  er_push_back(&buf, epoch);
 }
 
-uint16_t mean(void) {
-  uint32_t sum = 0;
-  uint32_t n = cb_size(&buf);
-  for (uint32_t i=0; i<n; i++) {
-    sum += *(uint8_t*)cb_peek(&buf, i);
-  }
-  return (uint16_t)(sum / n);
+static void delete_accel_checkpoint(void) {
+  persist_delete(CHECKPOINT_KEY);
 }
 
-// // Check whether accel data is at local maximum
-bool is_local_max(void) {
+// Write the ring, oldest epoch first, and the partial epoch to persist
+// storage in chunks of at most PERSIST_DATA_MAX_LENGTH bytes
+static void save_checkpoint(void) {
+  // The chunks are overwritten in place, so the last header would vouch
+  // for a mix of old and new data if the worker stopped partway; drop it
+  // until the new one goes in
+  delete_accel_checkpoint();
 
-  unsigned int num_buffer = cb_size(&buf);
-  unsigned int num_bins = EPOCHS_IN_BUFFER / EPOCHS_PER_BIN;
-    
-  if (num_buffer < EPOCHS_IN_BUFFER) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Number of samples requested is too high");
-    return false;
-  }
-  if (num_bins < 3) {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Number of samples requested is too low");
-    return false;
-  } 
-  
-  // Mean over whole datastore
-  uint16_t avg = mean() * EPOCHS_PER_BIN;
+  checkpoint_header header = {
+    .version = CHECKPOINT_VERSION,
+    .sample_rate = epoch_rate,
+    .timestamp = time(NULL),
+    .num_epochs = er_size(&buf),
+    .count = count,
+    .samples_counted = samples_counted,
+  };
   
-  // Calculate spike rates
-  uint16_t spikes_bins[3] = {0};
-  for (unsigned int i=0; i<3*EPOCHS_PER_BIN; i++) {
-    spikes_bins[i/EPOCHS_PER_BIN] += *(uint8_t*)cb_peek(&buf, i);
+  uint8_t chunk[PERSIST_DATA_MAX_LENGTH];
+  size_t used = 0;
+  uint32_t key = CHECKPOINT_DATA_KEY;
+  epoch_span spans[2];
+  size_t num_spans = er_spans(&buf, header.num_epochs, spans);
+  for (size_t s = 0; s < num_spans; s++) {
+    const uint8_t *data = spans[s].data;
+    size_t len = spans[s].len;
+    while (len > 0) {
+      size_t n = sizeof(chunk) - used;
+      if (n > len)
+        n = len;
+      memcpy(chunk + used, data, n);
+      used += n;
+      data += n;
+      len -= n;
+      if (used == sizeof(chunk)) {
+        persist_write_data(key++, chunk, used);
+        used = 0;
+      }
+    }
   }
+  if (used > 0)
+    persist_write_data(key, chunk, used);
+  
+  // Header last, so a half-written checkpoint has none
+  persist_write_data(CHECKPOINT_KEY, &header, sizeof(header));
+  epochs_since_checkpoint = 0;
+}
 
-#if DEBUG
-  data_logging_log(l_session_ref, &spikes_bins, 1);
-  data_logging_log(l_session_ref, &avg, 1);
-  data_logging_log(l_session_ref, &num_buffer, 1);
-#endif
-
-  // Middle bin should be above threshold
-  if (spikes_bins[1] <= avg)
+// Refill the ring from a recent checkpoint, if there is one
+static bool restore_checkpoint(void) {
+  checkpoint_header header;
+  if (persist_read_data(CHECKPOINT_KEY, &header, sizeof(header)) != 
+      sizeof(header) || header.version != CHECKPOINT_VERSION)
     return false;
   
-  // Slope must be negative
-  if (spikes_bins[0] > spikes_bins[1])
+  int32_t age = time(NULL) - header.timestamp;
+  if (age < 0 || age > CHECKPOINT_MAX_AGE) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Discarding stale checkpoint");
+    delete_accel_checkpoint();
     return false;
+  }
   
-  // Previous slope must be positive
-  if (spikes_bins[1] < spikes_bins[2])
-    return false;
+  // Skip the oldest epochs if the checkpoint holds more than fits
+  size_t skip = header.num_epochs > buf.capacity ? 
+                header.num_epochs - buf.capacity : 0;
+  uint8_t chunk[PERSIST_DATA_MAX_LENGTH];
+  uint32_t key = CHECKPOINT_DATA_KEY;
+  size_t remaining = header.num_epochs;
+  while (remaining > 0) {
+    size_t n = remaining < sizeof(chunk) ? remaining : sizeof(chunk);
+    if (persist_read_data(key++, chunk, n) != (int)n) {
+      APP_LOG(APP_LOG_LEVEL_ERROR, "Checkpoint data missing");
+      break;
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (skip > 0)
+        skip--;
+      else
+        push_epoch(chunk[i]);
+    }
+    remaining -= n;
+  }
 
+  // The partial epoch only carries on at the rate it was started at
+  if (header.sample_rate == g_params.sample_rate) {
+    count = header.count;
+    samples_counted = header.samples_counted;
+  }
+  APP_LOG(APP_LOG_LEVEL_INFO, "Restored %u epochs from checkpoint", 
+          (unsigned int)er_size(&buf));
   return true;
 }
 
-// Initialize
-void init_accel(void) {
-  APP_LOG(APP_LOG_LEVEL_INFO, "Acceleration logging ON");
-  uint32_t num_samples = SAMPLES_PER_BATCH;  // Number of samples per batch/callback
-  accel_data_service_subscribe(num_samples, accel_data_handler);
-  switch (SAMPLE_RATE) {
+static void accel_data_handler(AccelData *data, uint32_t num_samples);
+
+static void subscribe_accel(void) {
+  if (accel_subscribed)
+    return;
+  epoch_rate = g_params.sample_rate;
+  batch_samples = g_params.batch_samples;
+  accel_data_service_subscribe(batch_samples, accel_data_handler);
+  switch (epoch_rate) {
     case 10:
       accel_service_set_sampling_rate(ACCEL_SAMPLING_10HZ);
       break;
@@ -140,9 +191,191 @@ void init_accel(void) {
       break;
     default:
       APP_LOG(APP_LOG_LEVEL_ERROR, "Unsupported sampling rate");
+      epoch_rate = 10;
       accel_service_set_sampling_rate(ACCEL_SAMPLING_10HZ);
       break;
   }
+  accel_subscribed = true;
+  subscribed_time = time(NULL);
+}
+
+static void unsubscribe_accel(void) {
+  if (!accel_subscribed)
+    return;
+  accel_data_service_unsubscribe();
+  accel_subscribed = false;
+  g_stats.accel_seconds += time(NULL) - subscribed_time;
+}
+
+// Whether the most recent epochs were all still
+static bool is_quiet(void) {
+  if (er_size(&buf) < QUIET_EPOCHS)
+    return false;
+  uint16_t threshold = detector_mean(&buf);
+  if (threshold < QUIET_COUNT)
+    threshold = QUIET_COUNT;
+  for (unsigned int i = 0; i < QUIET_EPOCHS; i++) {
+    if (er_peek(&buf, i) > threshold)
+      return false;
+  }
+  return true;
+}
+
+// Store the finished epoch, scaled to a full epoch's worth of samples,
+// and pick the sampling mode for the next one
+static void close_epoch(void) {
+  uint32_t scaled = count;
+  if (samples_counted != SCALE_SAMPLES)
+    scaled = (scaled * SCALE_SAMPLES + samples_counted / 2) / samples_counted;
+  uint8_t epoch = scaled > 255 ? 255 : scaled;
+  baseline_push(&buf, epoch);
+  push_epoch(epoch);
+  history_append(epoch);
+  g_stats.epochs++;
+  if (live_epochs < UINT16_MAX)
+    live_epochs++;
+  if (samples_counted != SAMPLES_PER_EPOCH)
+    g_stats.quiet_epochs++;
+  if (++epochs_since_checkpoint >= CHECKPOINT_EPOCHS)
+    save_checkpoint();
+#if DEBUG  
+  data_logging_log(s_session_ref, &epoch, 1);
+#endif
+  count = 0;
+  samples_counted = 0;
+  
+  // Motion brings back full rate sampling straight away, stillness lets 
+  // the accelerometer sleep until the next minute tick. Between predicted
+  // peaks it sleeps whatever the wrist does.
+  bool quiet = sampling == ACCEL_RATE_SPARSE ||
+               (sampling == ACCEL_RATE_ADAPTIVE && is_quiet());
+  if (quiet != quiet_mode)
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Sampling %s", quiet ? "reduced" : "full");
+  quiet_mode = quiet;
+  if (quiet_mode)
+    unsubscribe_accel();
+}
+
+// Count zero-crossings in accelerometer data batches
+static void accel_data_handler(AccelData *data, uint32_t num_samples) {
+  stats_timer timer;
+  stats_timer_start(&timer);
+
+  // Count crossings of each axis with gravity removed. Samples taken
+  // while the vibe motor ran are discounted.
+  uint16_t valid = 0;
+  count += kernel_count(data, num_samples, &valid);
+  samples_counted += valid;
+  if (valid < num_samples) {
+    g_stats.vibe_samples += num_samples - valid;
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Vibrate invalidated %u datapoints",
+            (unsigned int)(num_samples - valid));
+  }
+
+  // Append the datastore if necessary
+  if (samples_counted >= (quiet_mode ? QUIET_SAMPLES : SAMPLES_PER_EPOCH))
+    close_epoch();
+
+  uint32_t ms = stats_timer_ms(&timer);
+  g_stats.batches++;
+  g_stats.samples += num_samples;
+  g_stats.accel_ms += ms;
+  if (ms > g_stats.accel_max_ms)
+    g_stats.accel_max_ms = ms;
+}
+
+// Check whether accel data is at local maximum
+bool is_local_max(void) {
+  stats_timer timer;
+  stats_timer_start(&timer);
+  bool peak = detector_is_peak(&buf);
+  g_stats.peak_checks++;
+  g_stats.peak_ms += stats_timer_ms(&timer);
+#if DEBUG
+  uint16_t avg = detector_mean(&buf);
+  uint16_t num_buffer = er_size(&buf);
+  data_logging_log(l_session_ref, &avg, 1);
+  data_logging_log(l_session_ref, &num_buffer, 1);
+#endif
+  return peak;
+}
+
+// Where the sleep cycle is heading, if the night so far shows one
+bool accel_predict(time_t now, cycle_prediction *prediction) {
+  return cycle_predict(&buf, now, prediction);
+}
+
+// Note how full the ring was when the alarm went off
+void accel_alarm_fired(bool peak) {
+  stats_fired(peak, er_size(&buf));
+}
+
+// What the recording looks like right now, for the app
+void accel_get_status(accel_status *status) {
+  size_t n = er_size(&buf);
+  *status = (accel_status) {
+    .ring_fill = n,
+    .last_epoch = n ? er_peek(&buf, 0) : 0,
+    .count = count,
+    .samples = samples_counted,
+    .score = detector_score(&buf),
+    .mean = detector_mean(&buf),
+  };
+}
+
+// Called every minute while recording. In reduced sampling each epoch
+// starts on the minute; full rate takes over straight away when asked for.
+void accel_minute_tick(AccelRate next) {
+  sampling = next;
+  if (quiet_mode && sampling == ACCEL_RATE_FULL) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Sampling full");
+    quiet_mode = false;
+  }
+  subscribe_accel();
+}
+
+// Take up new settings without losing the night so far. A new rate or
+// batch size means subscribing again; an epoch part counted at the old
+// rate is closed early if it has as many samples as a reduced rate one
+// would, and started again otherwise. The window is resized in place and
+// the detector fed it again, which also picks up a new detector or bin
+// length.
+void accel_reconfigure(void) {
+  if (g_params.sample_rate != epoch_rate && samples_counted > 0) {
+    if (samples_counted >= QUIET_SAMPLES) {
+      close_epoch();
+    } else {
+      count = 0;
+      samples_counted = 0;
+    }
+  }
+  if (accel_subscribed && (g_params.sample_rate != epoch_rate ||
+                           g_params.batch_samples != batch_samples)) {
+    unsubscribe_accel();
+    subscribe_accel();
+  }
+  er_resize(&buf, g_params.buffer_minutes);
+  detector_init(persist_exists(DETECTOR_KEY) ? 
+                (DetectorType)persist_read_int(DETECTOR_KEY) : DEFAULT_DETECTOR);
+  detector_rebuild(&buf);
+  g_stats.detector = detector_type();
+  g_stats.params = g_params;
+}
+
+// An epoch of Health history from before the accelerometer was on
+static void seed_epoch(uint8_t epoch, void *context) {
+  baseline_push(&buf, epoch);
+  push_epoch(epoch);
+  history_append(epoch);
+}
+
+// Initialize, seeding the ring from Health's minutes since backfill_from
+// if that is set and there is no checkpoint to carry on from
+void init_accel(time_t backfill_from) {
+  APP_LOG(APP_LOG_LEVEL_INFO, "Acceleration logging ON");
+  quiet_mode = false;
+  sampling = ACCEL_RATE_ADAPTIVE;
+  subscribe_accel();
 
 #if DEBUG  
   // Set up the datalogs
@@ -152,15 +385,48 @@ void init_accel(void) {
   data_logging_log(s_session_ref, &flag, 4);
 #endif
   
-  // Set up the circular buffer datastore
-  cb_init(&buf, EPOCHS_IN_BUFFER, sizeof(uint8_t));
+  // Set up the circular buffer datastore, with room for the longest window
+  // the settings allow
+  er_init(&buf, EPOCHS_IN_BUFFER);
+  er_resize(&buf, g_params.buffer_minutes);
+  detector_init(persist_exists(DETECTOR_KEY) ? 
+                (DetectorType)persist_read_int(DETECTOR_KEY) : DEFAULT_DETECTOR);
+  cycle_reset();
+  count = 0;
+  samples_counted = 0;
+  epochs_since_checkpoint = 0;
+  live_epochs = 0;
+  time_t now = time(NULL);
+  bool resumed = restore_checkpoint();
+  baseline_begin(&buf);
+  stats_begin(now, resumed);
+  g_stats.detector = detector_type();
+  g_stats.params = g_params;
+  bool seed = !resumed && backfill_from && backfill_from < now &&
+              backfill_available(now);
+  history_begin(seed ? backfill_from : now);
+  if (seed)
+    g_stats.seeded_epochs = backfill_seed(backfill_from, now, seed_epoch, NULL);
+  else if (!resumed && backfill_from)
+    APP_LOG(APP_LOG_LEVEL_WARNING, "Health history gone, starting with an empty ring");
 }
 
-// De-initialize if needed
-void deinit_accel(void) {
+// De-initialize if needed, keeping a checkpoint of the data if the worker
+// is only being stopped rather than finished for the night
+void deinit_accel(bool keep_data) {
   APP_LOG(APP_LOG_LEVEL_INFO, "Acceleration logging OFF");
-  accel_data_service_unsubscribe();
-  cb_free(&buf);
+  unsubscribe_accel();
+  if (keep_data) {
+    save_checkpoint();
+    history_flush();
+  } else {
+    delete_accel_checkpoint();
+    history_finish();
+    backfill_calibrate(&buf, live_epochs, time(NULL));
+  }
+  stats_save(keep_data);
+  baseline_save(!keep_data);
+  er_free(&buf);
 #if DEBUG
   data_logging_finish(l_session_ref);
   uint32_t flag = 0;
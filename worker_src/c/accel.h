@@ -1,7 +1,29 @@
 #pragma once
 #include <pebble_worker.h>
+#include "cycle.h"
 
-void init_accel(void);
-void deinit_accel(void);
+// How the accelerometer samples between minute ticks
+typedef enum {
+  ACCEL_RATE_ADAPTIVE,    // reduced while the wrist is still
+  ACCEL_RATE_FULL,        // every sample, as in the wakeup window
+  ACCEL_RATE_SPARSE,      // reduced regardless, between predicted peaks
+} AccelRate;
+
+typedef struct accel_status {
+  uint16_t ring_fill;     // epochs in the ring
+  uint8_t last_epoch;     // newest closed epoch
+  uint16_t count;         // crossings in the open epoch
+  uint16_t samples;       // samples in the open epoch
+  uint16_t score;         // detector score, see detector.h
+  uint16_t mean;          // mean epoch over the ring
+} accel_status;
+
+void init_accel(time_t backfill_from);
+void deinit_accel(bool keep_data);
+void accel_minute_tick(AccelRate rate);
+void accel_reconfigure(void);
+void accel_alarm_fired(bool peak);
+void accel_get_status(accel_status *status);
+bool accel_predict(time_t now, cycle_prediction *prediction);
 
 bool is_local_max(void);
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include <pebble_worker.h>
+#include "arena.h"
+
+_Static_assert(EPOCHS_IN_BUFFER <= 4096, "epoch window too long for the ring");
+_Static_assert(ARENA_SIZE <= ARENA_MAX_SIZE, "worker arena over budget");
+
+static uint8_t s_arena[ARENA_SIZE] __attribute__((aligned(4)));
+static size_t s_used = 0;
+
+// Take the next size bytes, word aligned
+void *arena_alloc(size_t size) {
+  size = (size + 3) & ~(size_t)3;
+  if (size > ARENA_SIZE - s_used) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Arena full, %u of %u B used",
+            (unsigned int)s_used, (unsigned int)ARENA_SIZE);
+    return NULL;
+  }
+  void *block = &s_arena[s_used];
+  s_used += size;
+  return block;
+}
+
+// Give back a block and everything taken after it
+void arena_free(void *block) {
+  if (block == NULL)
+    return;
+  size_t offset = (uint8_t *)block - s_arena;
+  if (offset < s_used)
+    s_used = offset;
+}
+
+size_t arena_used(void) {
+  return s_used;
+}
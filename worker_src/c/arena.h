@@ -0,0 +1,32 @@
+#pragma once
+#include <pebble_worker.h>
+
+// Long-lived worker state that would otherwise come from the heap, carved
+// out of one static block. Every user is sized here at compile time, so a
+// buffer that no longer fits fails the build rather than a malloc in the
+// middle of the night. Blocks are handed back in reverse order.
+
+// Longest epoch window the settings can pick (worker_src/c/params.h). The
+// ring is allocated at this length and resized within it, so raise
+// SECONDS_IN_BUFFER for longer analysis windows; the arena grows with it.
+#ifndef SECONDS_IN_BUFFER
+#define SECONDS_IN_BUFFER     (4 * SECONDS_PER_HOUR)
+#endif
+#define SECONDS_PER_EPOCH     SECONDS_PER_MINUTE
+#define EPOCHS_IN_BUFFER      (SECONDS_IN_BUFFER / SECONDS_PER_EPOCH)
+
+// Epoch ring storage is its capacity rounded up to a power of two
+#define ARENA_POW2(n)         ((n) <= 64 ? 64 : (n) <= 128 ? 128 : \
+                               (n) <= 256 ? 256 : (n) <= 512 ? 512 : \
+                               (n) <= 1024 ? 1024 : (n) <= 2048 ? 2048 : 4096)
+
+#define ARENA_EPOCH_RING      ARENA_POW2(EPOCHS_IN_BUFFER)
+#define ARENA_SIZE            (ARENA_EPOCH_RING)
+
+// Most the arena may take of the worker's memory. tools/memory_budget.py
+// checks the whole image after linking.
+#define ARENA_MAX_SIZE        2048
+
+void *arena_alloc(size_t size);
+void arena_free(void *block);
+size_t arena_used(void);
@@ -0,0 +1,162 @@
+#include <pebble_worker.h>
+#include "backfill.h"
+
+#if defined(PBL_HEALTH)
+
+#define BACKFILL_SCALE_KEY    320
+
+// Minutes read per call, kept on the stack
+#define CHUNK_MINUTES         15
+
+// A first guess at zero-crossings per VMC, replaced by what the nights
+// measure. Learned scales are kept within a factor of 16 either way.
+#define DEFAULT_SCALE         (1 << (BACKFILL_SCALE_SHIFT - 5))
+#define MIN_SCALE             (DEFAULT_SCALE / 16)
+#define MAX_SCALE             (DEFAULT_SCALE * 16)
+
+// Calibrate only on nights with enough movement in both to compare
+#define CALIBRATE_MIN_MINUTES 15
+#define CALIBRATE_MIN_EPOCHS  50
+
+static uint16_t load_scale(void) {
+  if (!persist_exists(BACKFILL_SCALE_KEY))
+    return DEFAULT_SCALE;
+  int32_t scale = persist_read_int(BACKFILL_SCALE_KEY);
+  return scale < MIN_SCALE ? MIN_SCALE : scale > MAX_SCALE ? MAX_SCALE : scale;
+}
+
+static uint8_t to_epoch(uint16_t vmc, uint16_t scale) {
+  uint32_t epoch = ((uint32_t)vmc * scale + (1 << (BACKFILL_SCALE_SHIFT - 1))) >>
+                   BACKFILL_SCALE_SHIFT;
+  return epoch > 255 ? 255 : epoch;
+}
+
+// Health keeps minute history as soon as it is on, so a few recent
+// minutes tell whether it is there to seed from
+bool backfill_available(time_t now) {
+  HealthMinuteData minutes[CHUNK_MINUTES];
+  time_t start = now - CHUNK_MINUTES * SECONDS_PER_MINUTE;
+  time_t end = now;
+  uint32_t n = health_service_get_minute_history(minutes, CHUNK_MINUTES, &start, &end);
+  for (uint32_t i = 0; i < n; i++) {
+    if (!minutes[i].is_invalid)
+      return true;
+  }
+  return false;
+}
+
+// Hand one epoch per minute from from to to to the handler, oldest first.
+// Minutes Health has no valid record for, including the newest ones it has
+// not written yet, repeat the nearest valid one before them, or after
+// them at the start. Nothing is handed over without any valid minute.
+uint16_t backfill_seed(time_t from, time_t to, BackfillEpochHandler handler,
+                       void *context) {
+  uint16_t scale = load_scale();
+  uint16_t total = (to - from) / SECONDS_PER_MINUTE;
+  uint16_t leading = 0;     // minutes before the first valid one
+  uint16_t filled = 0;
+  bool have_last = false;
+  uint8_t last = 0;
+  HealthMinuteData minutes[CHUNK_MINUTES];
+  time_t first = from - from % SECONDS_PER_MINUTE;
+  for (uint16_t m = 0; m < total; ) {
+    uint16_t want = total - m < CHUNK_MINUTES ? total - m : CHUNK_MINUTES;
+    time_t chunk_start = first + m * SECONDS_PER_MINUTE;
+    time_t chunk_end = chunk_start + want * SECONDS_PER_MINUTE;
+    time_t got_start = chunk_start;
+    uint32_t n = health_service_get_minute_history(minutes, want, &got_start, &chunk_end);
+    uint16_t offset = got_start > chunk_start ?
+                      (got_start - chunk_start) / SECONDS_PER_MINUTE : 0;
+    for (uint16_t i = 0; i < want; i++, m++) {
+      HealthMinuteData *minute = i >= offset && i - offset < n ?
+                                 &minutes[i - offset] : NULL;
+      if (minute == NULL || minute->is_invalid) {
+        if (!have_last) {
+          leading++;
+          continue;
+        }
+        filled++;
+      } else {
+        last = to_epoch(minute->vmc, scale);
+        if (!have_last) {
+          for (uint16_t j = 0; j < leading; j++)
+            handler(last, context);
+          filled += leading;
+          have_last = true;
+        }
+      }
+      handler(last, context);
+    }
+  }
+
+  if (!have_last) {
+    APP_LOG(APP_LOG_LEVEL_WARNING, "No Health history to seed from");
+    return 0;
+  }
+  APP_LOG(APP_LOG_LEVEL_INFO, "Seeded %u epochs from Health (%u filled in)",
+          (unsigned int)total, (unsigned int)filled);
+  return total;
+}
+
+// Compare the night's accelerometer epochs with Health's minutes over the
+// same span, newest first, and move the scale a quarter of the way towards
+// their ratio
+void backfill_calibrate(const epoch_ring *er, uint16_t live_epochs, time_t now) {
+  uint16_t span = live_epochs < er_size(er) ? live_epochs : er_size(er);
+  uint32_t epoch_sum = 0;
+  uint32_t vmc_sum = 0;
+  uint16_t matched = 0;
+  HealthMinuteData minutes[CHUNK_MINUTES];
+  time_t end = now - now % SECONDS_PER_MINUTE;
+  for (uint16_t age = 0; age < span; ) {
+    uint16_t want = span - age < CHUNK_MINUTES ? span - age : CHUNK_MINUTES;
+    time_t chunk_end = end - age * SECONDS_PER_MINUTE;
+    time_t chunk_start = chunk_end - want * SECONDS_PER_MINUTE;
+    time_t got_start = chunk_start;
+    uint32_t n = health_service_get_minute_history(minutes, want, &got_start, &chunk_end);
+    uint16_t offset = got_start > chunk_start ?
+                      (got_start - chunk_start) / SECONDS_PER_MINUTE : 0;
+    for (uint32_t i = 0; i < n && offset + i < want; i++) {
+      if (minutes[i].is_invalid)
+        continue;
+      // Record i of the chunk is the minute want - 1 - offset - i epochs
+      // older than the chunk's newest
+      epoch_sum += er_peek(er, age + want - 1 - offset - i);
+      vmc_sum += minutes[i].vmc;
+      matched++;
+    }
+    age += want;
+  }
+  if (matched < CALIBRATE_MIN_MINUTES || epoch_sum < CALIBRATE_MIN_EPOCHS ||
+      vmc_sum == 0)
+    return;
+
+  // The ring holds at most 4096 epochs of 255, so the shift fits
+  uint16_t scale = load_scale();
+  uint32_t measured = (epoch_sum << BACKFILL_SCALE_SHIFT) / vmc_sum;
+  if (measured < MIN_SCALE)
+    measured = MIN_SCALE;
+  if (measured > MAX_SCALE)
+    measured = MAX_SCALE;
+  uint16_t next = (3 * (uint32_t)scale + measured + 2) / 4;
+  APP_LOG(APP_LOG_LEVEL_INFO, "Health scale %u -> %u over %u minutes",
+          (unsigned int)scale, (unsigned int)next, (unsigned int)matched);
+  persist_write_int(BACKFILL_SCALE_KEY, next);
+}
+
+#else
+
+// Without Health the worker records the whole pre-recording period itself
+bool backfill_available(time_t now) {
+  return false;
+}
+
+uint16_t backfill_seed(time_t from, time_t to, BackfillEpochHandler handler,
+                       void *context) {
+  return 0;
+}
+
+void backfill_calibrate(const epoch_ring *er, uint16_t live_epochs, time_t now) {
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+#include <pebble_worker.h>
+#include "datastore.h"
+
+// Epochs from Pebble Health's minute history, for the hours before the
+// accelerometer is switched on. Health records a movement count (VMC)
+// every minute whatever the worker does, so on platforms that have it the
+// ring is seeded from that and raw sampling only starts BACKFILL_LEAD
+// before the wakeup window. Aplite has no Health and keeps recording for
+// the whole pre-recording period.
+//
+// VMC is on a different scale from the zero-crossing counts. Epoch =
+// VMC * scale >> BACKFILL_SCALE_SHIFT, with the scale learned at the end
+// of each night from the minutes that both Health and the accelerometer
+// saw.
+
+// Live sampling before the window, long enough for the bins detector's
+// three bins to be all accelerometer epochs by the time it opens
+#define BACKFILL_LEAD_SECONDS (30 * SECONDS_PER_MINUTE)
+
+#define BACKFILL_SCALE_SHIFT  12
+
+typedef void (*BackfillEpochHandler)(uint8_t epoch, void *context);
+
+bool backfill_available(time_t now);
+uint16_t backfill_seed(time_t from, time_t to, BackfillEpochHandler handler,
+                       void *context);
+void backfill_calibrate(const epoch_ring *er, uint16_t live_epochs, time_t now);
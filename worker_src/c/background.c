@@ -1,102 +1,320 @@
 #include <pebble_worker.h>
 #include "background.h"
 #include "accel.h"
+#include "arena.h"
+#include "backfill.h"
+#include "schedule.h"
+#include "detector.h"
+#include "params.h"
+#include "protocol.h"
 
-#define ALARM_HOUR_KEY            0
-#define ALARM_MINUTE_KEY          1
+#define PRE_RECORDING_SECONDS     (g_params.pre_recording_minutes * SECONDS_PER_MINUTE)
 
-#define PRE_RECORDING_SECONDS     4 * SECONDS_PER_HOUR
-#define WAKEUP_WINDOW_SECONDS     30 * SECONDS_PER_MINUTE
+// How close to a predicted peak the peak checks start, and how long
+// before them full rate sampling does, so the detectors see the run up to
+// the peak at full rate
+#define CYCLE_MARGIN_SECONDS      (10 * SECONDS_PER_MINUTE)
+#define CYCLE_RUN_UP_SECONDS      (20 * SECONDS_PER_MINUTE)
 
-#define SENDER_WORKER             0
-#define SENDER_APP                1
+typedef enum {
+  STATE_IDLE,           // nothing to do until recording starts
+  STATE_PRE_RECORDING,  // filling the epoch buffer
+  STATE_WAKEUP_WINDOW,  // looking for a peak to wake on
+  STATE_FIRED,          // woke early, waiting for the alarm time to pass
+} WorkerState;
+
+static const char *state_names[] = {
+  "idle", "pre-recording", "wakeup window", "fired"
+};
 
 time_t alarm_time;
 bool accel_is_on = false;
+static bool alarm_is_set = false;
+static WorkerState state = STATE_IDLE;
+static TimeUnits tick_units = 0;
+
+// Transition times for the next alarm in the schedule
+static time_t recording_time;
+static time_t window_time;
+static time_t backfill_from;  // Health history to seed the ring with, or 0
+static bool backfill_checked;
+
+// The window as planned around the predicted cycle: peak checks start at
+// wake_from, full rate sampling at full_from, and neither moves once
+// sampling has gone to full rate
+static time_t wake_from;
+static time_t full_from;
+static bool window_fixed;
+static time_t fired_alarm_time;
+
+static void update_transitions(void) {
+  alarm_time = schedule_fire_time();
+  window_time = alarm_time - schedule_window();
+  recording_time = window_time - PRE_RECORDING_SECONDS;
+  backfill_from = 0;
+  backfill_checked = false;
+  wake_from = full_from = window_time;
+  window_fixed = false;
+}
+
+// Where Health records the night anyway, the pre-recording period comes
+// from its minute history and the accelerometer waits until just before
+// the window. Checked when pre-recording is due, so Health has had the
+// evening to show it is on.
+static void check_backfill(time_t now) {
+  if (backfill_checked || !alarm_is_set || state != STATE_IDLE ||
+      now < recording_time)
+    return;
+  backfill_checked = true;
+  if (!backfill_available(now))
+    return;
+  backfill_from = recording_time;
+  recording_time = window_time - BACKFILL_LEAD_SECONDS;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Pre-recording from Health");
+}
+
+// Lookup the next alarm in the weekly schedule
+static void find_alarm_time(bool any) {
+  if (!any) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "No alarm set");
+    alarm_is_set = false;
+    return;
+  }
+  schedule_find(time(NULL));
+
+  // The alarm that fired early is still ahead of now until its time, but
+  // it has rung
+  if (state == STATE_FIRED)
+    while (schedule_fire_time() <= fired_alarm_time)
+      schedule_advance();
+  alarm_is_set = true;
+  update_transitions();
+}
 
 void load_alarm_time(void) {
-  
-  // Lookup the alarm time
-  int hour;
-  int minute;
-  if (persist_exists(ALARM_HOUR_KEY) && persist_exists(ALARM_MINUTE_KEY)) {
-    hour = persist_read_int(ALARM_HOUR_KEY);
-    minute = persist_read_int(ALARM_MINUTE_KEY);
-  } else {
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "No alarm set, error");
+  find_alarm_time(schedule_load());
+}
+
+static void tick_handler(struct tm *tick_time, TimeUnits changed);
+
+// Tick every minute while recording or about to start, hourly on the day
+// before, daily on nights without an alarm, and not at all without any
+static void update_tick_units(time_t now) {
+  TimeUnits units;
+  if (!alarm_is_set)
+    units = 0;
+  else if (state == STATE_PRE_RECORDING || state == STATE_WAKEUP_WINDOW ||
+           (state == STATE_IDLE && recording_time - now <= SECONDS_PER_HOUR))
+    units = MINUTE_UNIT;
+  else if (recording_time - now <= SECONDS_PER_DAY)
+    units = HOUR_UNIT;
+  else
+    units = DAY_UNIT;
+
+  if (units == tick_units)
     return;
+  tick_units = units;
+  if (units)
+    tick_timer_service_subscribe(units, tick_handler);
+  else
+    tick_timer_service_unsubscribe();
+}
+
+static WorkerState state_at(time_t now) {
+  if (!alarm_is_set)
+    return STATE_IDLE;
+  if (state == STATE_FIRED && now < fired_alarm_time)
+    return STATE_FIRED;
+  if (now >= window_time)
+    return STATE_WAKEUP_WINDOW;
+  if (now >= recording_time)
+    return STATE_PRE_RECORDING;
+  return STATE_IDLE;
+}
+
+// Move to the state for the given time, switching recording on or off
+static void update_state(time_t now) {
+  check_backfill(now);
+  WorkerState next = state_at(now);
+  if (next != state)
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Worker %s", state_names[next]);
+  state = next;
+
+  bool recording = state == STATE_PRE_RECORDING ||
+                   state == STATE_WAKEUP_WINDOW;
+  if (recording && !accel_is_on) {
+    init_accel(backfill_from);
+    accel_is_on = true;
+  } else if (!recording && accel_is_on) {
+    deinit_accel(false);
+    accel_is_on = false;
   }
-  alarm_time = time_start_of_today() + (hour*SECONDS_PER_HOUR) + (minute*SECONDS_PER_MINUTE);
-  
-  // Next occuring alarm time
-  while (alarm_time < time(NULL))
-    alarm_time = alarm_time + SECONDS_PER_DAY;
-}
-
-static void trigger_alarm(void) {
-  AppWorkerMessage message = {
-    .data0 = true
-  };
-  app_worker_send_message(SENDER_WORKER, &message); // if app is open already
+  update_tick_units(now);
+}
+
+// Written before anything else, so the flash write counts towards the
+// measured latency rather than hiding in front of it
+static void stamp_fire(void) {
+  time_t seconds;
+  fire_stamp stamp;
+  time_ms(&seconds, &stamp.ms);
+  stamp.seconds = seconds;
+  persist_write_data(FIRE_STAMP_KEY, &stamp, sizeof(stamp));
+}
+
+static void trigger_alarm(bool peak) {
+  stamp_fire();
+  if (accel_is_on)
+    accel_alarm_fired(peak);
+  protocol_send(PROTOCOL_ALARM_FIRED, 0, peak, 0); // if app is open already
   worker_launch_app(); // if app is closed
-  alarm_time += SECONDS_PER_DAY;
+  fired_alarm_time = alarm_time;
+  schedule_advance();
+  update_transitions();
+  state = STATE_FIRED;
 }
 
-static void tick_handler(struct tm *tick_time, TimeUnits changed) {
-  
-  // Check alarm time for trigger regardless of recording status
-  if (mktime(tick_time) >= alarm_time) { 
-    trigger_alarm();
-    if (accel_is_on) {
-      deinit_accel();
-      accel_is_on = false;
-      return;
+// Fit the window to the next predicted peak once the night shows a clear
+// cycle. Peak checks wait until CYCLE_MARGIN before it, though never
+// earlier than the window opens, and full rate sampling starts at the same
+// point, even if that is before the window, so the detector has the run
+// up at full rate. Away from any predicted peak the accelerometer is
+// sampled sparsely. Without a prediction the window is as set.
+static AccelRate plan_window(time_t now) {
+  if (window_fixed)
+    return ACCEL_RATE_FULL;
+  cycle_prediction prediction;
+  bool predicted = accel_predict(now, &prediction);
+  wake_from = full_from = window_time;
+  time_t period = 0;
+  if (predicted) {
+    period = prediction.period * SECONDS_PER_EPOCH;
+    time_t peak = prediction.next_peak;
+    while (peak + CYCLE_MARGIN_SECONDS < window_time)
+      peak += period;
+    if (peak - CYCLE_MARGIN_SECONDS < alarm_time) {
+      wake_from = peak - CYCLE_MARGIN_SECONDS;
+      if (wake_from < window_time)
+        wake_from = window_time;
+      full_from = peak - CYCLE_MARGIN_SECONDS - CYCLE_RUN_UP_SECONDS;
+      if (full_from > wake_from)
+        full_from = wake_from;
     }
   }
-  
-  // Trigger the alarm if we're in the wakeup window and the datastore 
+  if (now >= full_from) {
+    window_fixed = true;
+    if (predicted)
+      APP_LOG(APP_LOG_LEVEL_DEBUG, "Cycle %u min (%u%%), checking from %+d min",
+              (unsigned int)prediction.period, (unsigned int)prediction.confidence,
+              (int)(wake_from - window_time) / SECONDS_PER_MINUTE);
+    return ACCEL_RATE_FULL;
+  }
+  if (!predicted)
+    return ACCEL_RATE_ADAPTIVE;
+  bool near_peak = prediction.next_peak - now <= CYCLE_MARGIN_SECONDS + CYCLE_RUN_UP_SECONDS ||
+                   now - (prediction.next_peak - period) <= CYCLE_MARGIN_SECONDS;
+  return near_peak ? ACCEL_RATE_ADAPTIVE : ACCEL_RATE_SPARSE;
+}
+
+static void tick_handler(struct tm *tick_time, TimeUnits changed) {
+  time_t now = mktime(tick_time);
+
+  // Check alarm time for trigger regardless of recording status, though
+  // never for an alarm that has already fired
+  if (now >= alarm_time && alarm_time != fired_alarm_time) {
+    trigger_alarm(false);
+
+  // Trigger the alarm if we're in the wakeup window and the datastore
   // is currently in a local maxmimum
-  if (accel_is_on && 
-      mktime(tick_time) >= alarm_time - WAKEUP_WINDOW_SECONDS && 
-      is_local_max()) {
+  } else if (state == STATE_WAKEUP_WINDOW && now >= wake_from && is_local_max()) {
     APP_LOG(APP_LOG_LEVEL_INFO, "Alarm triggered");
-    deinit_accel();
-    accel_is_on = false;
-    trigger_alarm();
-    APP_LOG(APP_LOG_LEVEL_DEBUG, "Setting a new alarm for %u hours from now", 
-            (unsigned int)(alarm_time - time(NULL))/SECONDS_PER_HOUR);
-  }
-  
-  // If the alarm time was changed recently, may need to turn off accelerometer
-  if (accel_is_on && 
-      mktime(tick_time) < alarm_time - WAKEUP_WINDOW_SECONDS -
-                          PRE_RECORDING_SECONDS) {
-    deinit_accel();
-    accel_is_on = false;
-    return;
-  }
-  
-  // Turn on acceleration logging if needed
-  if (!accel_is_on && 
-      mktime(tick_time) >= alarm_time - WAKEUP_WINDOW_SECONDS -
-                           PRE_RECORDING_SECONDS) {
-    init_accel();
-    accel_is_on = true;
+    trigger_alarm(true);
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Setting a new alarm for %u hours from now",
+            (unsigned int)(alarm_time - now)/SECONDS_PER_HOUR);
   }
+
+  update_state(now);
+
+  if (accel_is_on)
+    accel_minute_tick(plan_window(now));
+}
+
+// The next time the worker changes what it is doing, or 0 without an alarm
+static time_t next_transition(time_t now) {
+  if (!alarm_is_set)
+    return 0;
+  if (state == STATE_FIRED && fired_alarm_time > now)
+    return fired_alarm_time;
+  if (recording_time > now)
+    return recording_time;
+  if (window_time > now)
+    return window_time;
+  return alarm_time;
 }
 
-// Handle when the app sends a message (update the alarm time)
+// Answer a status query in four parts under its sequence number. The app
+// takes the last one as complete.
+static void send_status(uint8_t seq) {
+  accel_status status = {0};
+  if (accel_is_on)
+    accel_get_status(&status);
+  uint32_t next = (uint32_t)next_transition(time(NULL));
+  protocol_send(PROTOCOL_STATUS_RECORDING, seq, status.ring_fill,
+                (state << PROTOCOL_STATE_SHIFT) |
+                (detector_type() << PROTOCOL_DETECTOR_SHIFT) | status.last_epoch);
+  protocol_send(PROTOCOL_STATUS_EPOCH, seq, status.count, status.samples);
+  protocol_send(PROTOCOL_STATUS_SCORE, seq, status.score, status.mean);
+  protocol_send(PROTOCOL_STATUS_NEXT, seq, next >> 16, next & 0xffff);
+}
+
+// Handle when the app sends a message. Slot changes carry their value,
+// status queries are answered straight from memory, new parameters are
+// taken up without stopping, and a reload means re-reading the settings.
 static void worker_message_handler(uint16_t type, AppWorkerMessage *message) {
-  if (type == SENDER_APP)
-    load_alarm_time();
+  if (type != PROTOCOL_SENDER_APP)
+    return;
+  switch (protocol_command(message)) {
+    case PROTOCOL_ALARM_SLOT: {
+      uint16_t minute = message->data1 & ((1 << PROTOCOL_SLOT_SHIFT) - 1);
+      alarm_slot alarm = {
+        .hour = minute / 60,
+        .minute = minute % 60,
+        .days = message->data2 & ((1 << PROTOCOL_WINDOW_SHIFT) - 1),
+        .window_minutes = message->data2 >> PROTOCOL_WINDOW_SHIFT,
+      };
+      find_alarm_time(schedule_set_slot(message->data1 >> PROTOCOL_SLOT_SHIFT, &alarm));
+      break;
+    }
+    case PROTOCOL_QUERY_STATUS:
+      send_status(protocol_seq(message));
+      return;
+    case PROTOCOL_PARAMS:
+
+      // A night being recorded keeps its start; a new pre-recording length
+      // counts from the next one
+      params_load();
+      if (accel_is_on)
+        accel_reconfigure();
+      else if (alarm_is_set)
+        update_transitions();
+      break;
+    default:
+      load_alarm_time();
+      break;
+  }
+  update_state(time(NULL));
 }
 
 void background_init(void) {
-  
+
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Background process started");
+  params_load();
   load_alarm_time();
-  tick_timer_service_subscribe(MINUTE_UNIT, tick_handler);
-  
+
+  // Resume recording straight away if we were restarted mid-night, so the
+  // checkpointed data isn't a minute older than it needs to be
+  update_state(time(NULL));
+
   // Subscribe to worker messages
   app_worker_message_subscribe(worker_message_handler);
 }
@@ -104,13 +322,16 @@ void background_init(void) {
 void background_deinit(void) {
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Background process stopped");
   if (accel_is_on) {
-    deinit_accel();
+    deinit_accel(true);
     accel_is_on = false;
   }
+  tick_timer_service_unsubscribe();
+  tick_units = 0;
 }
 
 int main(void) {
   background_init();
   worker_event_loop();
   background_deinit();
+  return 0;
 }
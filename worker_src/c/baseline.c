@@ -0,0 +1,108 @@
+#include <pebble_worker.h>
+#include "baseline.h"
+
+#define BASELINE_KEY          330
+#define BASELINE_VERSION      1
+
+// Averages move 1/512 of the way per epoch, about two nights' worth
+#define DECAY_SHIFT           9
+
+// The model counts as this many epochs of the window once it has a night
+// behind it, and the window mean is capped at its 90th percentile
+#define BASELINE_WEIGHT       60
+
+static baseline_model s_model;
+static uint16_t s_bin;            // newest BASELINE_BIN_EPOCHS epochs
+static uint8_t s_bin_epochs;
+
+static uint16_t isqrt(uint32_t x) {
+  uint32_t root = 0;
+  for (uint32_t bit = 1UL << 30; bit; bit >>= 2) {
+    if (x >= root + bit) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+  }
+  return root;
+}
+
+// Load the model and pick up the bin from whatever the ring already holds,
+// such as a restored checkpoint, without learning from it again
+void baseline_begin(const epoch_ring *er) {
+  if (persist_read_data(BASELINE_KEY, &s_model, sizeof(s_model)) != sizeof(s_model) ||
+      s_model.version != BASELINE_VERSION) {
+    memset(&s_model, 0, sizeof(s_model));
+    s_model.version = BASELINE_VERSION;
+  }
+  size_t n = er_size(er);
+  s_bin_epochs = n < BASELINE_BIN_EPOCHS - 1 ? n : BASELINE_BIN_EPOCHS - 1;
+  s_bin = 0;
+  for (uint8_t i = 0; i < s_bin_epochs; i++)
+    s_bin += er_peek(er, i);
+}
+
+// Feed a new epoch before it goes into the ring. The quantile moves up by
+// nine steps when a bin is above it and down by one when below, which
+// settles where one bin in ten is above; a step is a sixty-fourth of the
+// standard deviation.
+void baseline_push(const epoch_ring *er, uint8_t epoch) {
+  if (s_bin_epochs == BASELINE_BIN_EPOCHS)
+    s_bin -= er_peek(er, BASELINE_BIN_EPOCHS - 1);
+  else
+    s_bin_epochs++;
+  s_bin += epoch;
+  if (s_bin_epochs < BASELINE_BIN_EPOCHS)
+    return;
+
+  // An empty model starts from the first bin
+  if (s_model.mean == 0 && s_model.variance == 0 && s_model.p90 == 0) {
+    s_model.mean = (uint32_t)s_bin << 8;
+    s_model.p90 = s_bin << 4;
+    return;
+  }
+  int32_t d = ((int32_t)s_bin << 8) - (int32_t)s_model.mean;
+  s_model.mean += d >> DECAY_SHIFT;
+  int32_t units = d / 256;
+  uint32_t square = (uint32_t)(units * units);
+  s_model.variance += ((int32_t)square - (int32_t)s_model.variance) >> DECAY_SHIFT;
+
+  uint16_t step = isqrt(s_model.variance) * 16 / 64;
+  if (step == 0)
+    step = 1;
+  uint16_t x = s_bin << 4;
+  if (x > s_model.p90) {
+    uint32_t up = s_model.p90 + 9 * (uint32_t)step;
+    s_model.p90 = up > UINT16_MAX ? UINT16_MAX : up;
+  } else if (x < s_model.p90) {
+    s_model.p90 = s_model.p90 > step ? s_model.p90 - step : 0;
+  }
+}
+
+// Kept across restarts too; only a finished night counts towards trusting it
+void baseline_save(bool finished) {
+  if (finished && s_model.mean && s_model.nights < UINT8_MAX)
+    s_model.nights++;
+  persist_write_data(BASELINE_KEY, &s_model, sizeof(s_model));
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Baseline bin %lu, sd %u, p90 %u over %u nights",
+          (unsigned long)(s_model.mean >> 8), isqrt(s_model.variance),
+          s_model.p90 >> 4, s_model.nights);
+}
+
+// The bin level for the detector: the window's mean bin, capped at the
+// usual 90th percentile, averaged with the usual mean in proportion to the
+// epochs behind each. Without a finished night the window's mean stands.
+uint16_t baseline_blend(uint16_t window_bin, size_t window_epochs) {
+  if (s_model.nights == 0)
+    return window_bin;
+  uint32_t cap = s_model.p90 >> 4;
+  uint32_t window = window_bin < cap ? window_bin : cap;
+  uint32_t usual = s_model.mean >> 8;
+  return (window * window_epochs + usual * BASELINE_WEIGHT) /
+         (window_epochs + BASELINE_WEIGHT);
+}
+
+const baseline_model *baseline_get(void) {
+  return &s_model;
+}
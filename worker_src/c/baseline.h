@@ -0,0 +1,26 @@
+#pragma once
+#include <pebble_worker.h>
+#include "datastore.h"
+
+// The wearer's usual level of movement, carried from night to night in
+// persist storage: moving averages of the mean and variance of ten epoch
+// bin totals, and a running estimate of their 90th percentile. Every epoch
+// updates it in constant time. The bins detector blends it with the
+// night's own window mean, so its threshold is steady early in the night
+// and after a restless stretch.
+
+#define BASELINE_BIN_EPOCHS   10
+
+typedef struct baseline_model {
+  uint8_t version;
+  uint8_t nights;           // nights that have finished updating it
+  uint16_t p90;             // 90th percentile of bin totals, 1/16ths
+  uint32_t mean;            // mean bin total, 1/256ths
+  uint32_t variance;        // of bin totals
+} baseline_model;
+
+void baseline_begin(const epoch_ring *er);
+void baseline_push(const epoch_ring *er, uint8_t epoch);
+void baseline_save(bool finished);
+uint16_t baseline_blend(uint16_t window_bin, size_t window_epochs);
+const baseline_model *baseline_get(void);
@@ -0,0 +1,89 @@
+#include <pebble_worker.h>
+#include "cycle.h"
+#include "arena.h"
+#include "detector.h"
+
+// Lagged products decay by 1/256 per epoch, so a night's early cycles
+// count for less than its recent ones
+#define DECAY_SHIFT           8
+
+// Prediction needs this many epochs of products and a correlation of at
+// least MIN_CONFIDENCE percent at the best lag
+#define MIN_EPOCHS            30
+#define MIN_CONFIDENCE        25
+
+// The last peak is the busiest run of SMOOTH_EPOCHS within one period
+#define SMOOTH_EPOCHS         10
+
+static int32_t s_lagged[CYCLE_LAGS];
+static int32_t s_variance;
+static uint16_t s_epochs;
+
+void cycle_reset(void) {
+  memset(s_lagged, 0, sizeof(s_lagged));
+  s_variance = 0;
+  s_epochs = 0;
+}
+
+// Products of the new epoch with the one each lag back, both about the
+// ring's mean. Centred values fit in 9 bits, so the decayed sums stay
+// under 2^24 and can still be taken as a percentage in 32 bits.
+void cycle_push(const epoch_ring *er, uint8_t epoch) {
+  if (er->capacity <= CYCLE_MAX_LAG || er_size(er) < CYCLE_MAX_LAG)
+    return;
+  int32_t mean = detector_mean(er);
+  int32_t x = (int32_t)epoch - mean;
+  s_variance += x * x - (s_variance >> DECAY_SHIFT);
+  for (unsigned int i = 0; i < CYCLE_LAGS; i++) {
+    // The ring doesn't hold the new epoch yet, so lag L is L - 1 back
+    int32_t y = (int32_t)er_peek(er, CYCLE_MIN_LAG + i * CYCLE_LAG_STEP - 1) - mean;
+    s_lagged[i] += x * y - (s_lagged[i] >> DECAY_SHIFT);
+  }
+  if (s_epochs < UINT16_MAX)
+    s_epochs++;
+}
+
+// The period is the lag with the strongest correlation. The next peak is
+// one period on from the middle of the busiest run in the last period.
+bool cycle_predict(const epoch_ring *er, time_t now, cycle_prediction *prediction) {
+  if (s_epochs < MIN_EPOCHS || s_variance <= 0)
+    return false;
+  unsigned int best = 0;
+  for (unsigned int i = 1; i < CYCLE_LAGS; i++) {
+    if (s_lagged[i] > s_lagged[best])
+      best = i;
+  }
+  if (s_lagged[best] <= 0)
+    return false;
+  uint16_t confidence = s_lagged[best] * 100 / s_variance;
+  if (confidence < MIN_CONFIDENCE)
+    return false;
+  uint16_t period = CYCLE_MIN_LAG + best * CYCLE_LAG_STEP;
+
+  if (er_size(er) < SMOOTH_EPOCHS)
+    return false;
+  size_t ages = er_size(er) - SMOOTH_EPOCHS + 1;
+  if (ages > period)
+    ages = period;
+  uint16_t run = 0;
+  for (size_t a = 0; a < SMOOTH_EPOCHS; a++)
+    run += er_peek(er, a);
+  uint16_t busiest = run;
+  size_t busiest_age = 0;
+  for (size_t a = 1; a < ages; a++) {
+    run += er_peek(er, a + SMOOTH_EPOCHS - 1) - er_peek(er, a - 1);
+    if (run > busiest) {
+      busiest = run;
+      busiest_age = a;
+    }
+  }
+
+  // Age 0 is the epoch that ended at the last minute tick
+  time_t peak = now - (time_t)(busiest_age + SMOOTH_EPOCHS / 2) * SECONDS_PER_EPOCH;
+  *prediction = (cycle_prediction) {
+    .period = period,
+    .confidence = confidence,
+    .next_peak = peak + (time_t)period * SECONDS_PER_EPOCH,
+  };
+  return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <pebble_worker.h>
+#include "datastore.h"
+
+// Sleep cycle period from the autocorrelation of the epoch counts. Like
+// the detectors it sees every epoch just before it goes into the ring,
+// and each epoch updates a fixed set of lags, so the cost per epoch is
+// bounded by CYCLE_LAGS. The lags only run once the ring reaches back
+// past the longest one.
+
+#define CYCLE_MIN_LAG         60
+#define CYCLE_MAX_LAG         118
+#define CYCLE_LAG_STEP        2
+#define CYCLE_LAGS            ((CYCLE_MAX_LAG - CYCLE_MIN_LAG) / CYCLE_LAG_STEP + 1)
+
+typedef struct cycle_prediction {
+  uint16_t period;          // epochs between peaks
+  uint16_t confidence;      // autocorrelation at the period, in percent
+  time_t next_peak;         // the first predicted peak from now on
+} cycle_prediction;
+
+void cycle_reset(void);
+void cycle_push(const epoch_ring *er, uint8_t epoch);
+bool cycle_predict(const epoch_ring *er, time_t now, cycle_prediction *prediction);
@@ -1,20 +1,25 @@
 #include <pebble_worker.h>
 #include "datastore.h"
+#include "arena.h"
 
 
-// Create a new circular buffer
-void cb_init(circular_buffer *cb, size_t capacity, size_t sz)
+// Create a new circular buffer. If there is no memory for it, it stays
+// empty and pushes are dropped.
+bool cb_init(circular_buffer *cb, size_t capacity, size_t sz)
 {
   APP_LOG(APP_LOG_LEVEL_DEBUG, "Allocating %u B buffer", 
           (unsigned int)(capacity * sz));
   cb->buffer = malloc(capacity * sz);
-  if(cb->buffer == NULL)
+  cb->count = 0;
+  cb->sz = sz;
+  if(cb->buffer == NULL) {
     APP_LOG(APP_LOG_LEVEL_ERROR, "Memory allocation failed");
+    capacity = 0;
+  }
   cb->buffer_end = (char *)cb->buffer + capacity * sz;
   cb->capacity = capacity;
-  cb->count = 0;
-  cb->sz = sz;
   cb->head = cb->buffer;
+  return cb->buffer != NULL;
 }
 
 // Release memory for the buffer array
@@ -31,6 +36,8 @@ void cb_free(circular_buffer *cb)
 // Add a new item to the buffer
 void cb_push_back(circular_buffer *cb, const void *item)
 {
+  if (cb->buffer == NULL)
+    return;
   memcpy(cb->head, item, cb->sz);
   cb->head = (char*)cb->head + cb->sz;
   if(cb->head == cb->buffer_end)
@@ -58,4 +65,77 @@ void* cb_peek(circular_buffer *cb, size_t index)
   if (item < cb->buffer)
     item = cb->buffer_end - (cb->buffer - item);
   return item;
-}
\ No newline at end of file
+}
+
+// Where a ring without storage writes, so pushes need no check
+static uint8_t s_sink;
+
+// Create a new epoch ring with room for capacity items, in the worker
+// arena. If the arena is full the ring stays empty.
+bool er_init(epoch_ring *er, size_t capacity)
+{
+  size_t storage = 1;
+  while (storage < capacity)
+    storage <<= 1;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Allocating %u B epoch ring", 
+          (unsigned int)storage);
+  er->buffer = arena_alloc(storage);
+  er->mask = storage - 1;
+  er->capacity = capacity;
+  er->count = 0;
+  er->head = 0;
+  if(er->buffer == NULL) {
+    er->buffer = &s_sink;
+    er->mask = 0;
+    er->capacity = 0;
+    return false;
+  }
+  return true;
+}
+
+// Hand the ring's storage back to the arena
+void er_free(epoch_ring *er)
+{
+  if (er->buffer != &s_sink)
+    arena_free(er->buffer);
+  er->buffer = NULL;
+  er->mask = 0;
+  er->capacity = 0;
+  er->count = 0;
+  er->head = 0;
+}
+
+// Change the window length within the storage the ring already has. The
+// newest items stay where they are; shrinking drops the oldest.
+void er_resize(epoch_ring *er, size_t capacity)
+{
+  if (capacity > (size_t)er->mask + 1)
+    capacity = er->mask + 1;
+  if (er->buffer == &s_sink)
+    capacity = 0;
+  er->capacity = capacity;
+  if (er->count > capacity)
+    er->count = capacity;
+}
+
+// Describe the newest n items (all of them if n is larger) as at most two
+// contiguous runs in chronological order. Returns the number of runs.
+size_t er_spans(const epoch_ring *er, size_t n, epoch_span spans[2])
+{
+  if (n > er->count)
+    n = er->count;
+  if (n == 0)
+    return 0;
+  size_t start = (er->head - n) & er->mask;
+  size_t first = er->mask + 1 - start;
+  if (first >= n) {
+    spans[0].data = er->buffer + start;
+    spans[0].len = n;
+    return 1;
+  }
+  spans[0].data = er->buffer + start;
+  spans[0].len = first;
+  spans[1].data = er->buffer;
+  spans[1].len = n - first;
+  return 2;
+}
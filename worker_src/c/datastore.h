@@ -10,8 +10,51 @@ typedef struct circular_buffer
     void *head;       // pointer to head
 } circular_buffer;
 
-void cb_init(circular_buffer *cb, size_t capacity, size_t sz);
+bool cb_init(circular_buffer *cb, size_t capacity, size_t sz);
 void cb_free(circular_buffer *cb);
 void cb_push_back(circular_buffer *cb, const void *item);
 size_t cb_size(circular_buffer *cb);
-void* cb_peek(circular_buffer *cb, size_t index);
\ No newline at end of file
+void* cb_peek(circular_buffer *cb, size_t index);
+
+// Ring of one-byte epoch counts. Storage is rounded up to a power of two
+// so indices wrap with a mask; capacity is the logical window length.
+typedef struct epoch_ring
+{
+    uint8_t *buffer;  // data buffer
+    uint16_t mask;    // storage length - 1
+    uint16_t capacity;// maximum number of items in the window
+    uint16_t count;   // number of items in the window
+    uint16_t head;    // index of the next write
+} epoch_ring;
+
+// Contiguous run of items, oldest first
+typedef struct epoch_span
+{
+    const uint8_t *data;
+    size_t len;
+} epoch_span;
+
+bool er_init(epoch_ring *er, size_t capacity);
+void er_free(epoch_ring *er);
+void er_resize(epoch_ring *er, size_t capacity);
+size_t er_spans(const epoch_ring *er, size_t n, epoch_span spans[2]);
+
+// Add a new item, dropping the oldest once the window is full
+static inline void er_push_back(epoch_ring *er, uint8_t item)
+{
+    er->buffer[er->head] = item;
+    er->head = (er->head + 1) & er->mask;
+    if (er->count < er->capacity)
+        er->count++;
+}
+
+static inline size_t er_size(const epoch_ring *er)
+{
+    return er->count;
+}
+
+// Item by age, 0 being the newest. The index is not range checked.
+static inline uint8_t er_peek(const epoch_ring *er, size_t index)
+{
+    return er->buffer[(er->head - 1 - index) & er->mask];
+}
@@ -0,0 +1,271 @@
+#include <pebble_worker.h>
+#include "detector.h"
+#include "baseline.h"
+#include "params.h"
+
+// Three bins of one minute epochs, as long as the settings say
+#define PEAK_BINS             3
+
+// Moving averages in 1/256ths of a crossing. The fast one follows the
+// last ten minutes or so, the slow one the last hour; a peak is the fast
+// one turning down at least a quarter above the slow one.
+#define EMA_FAST_DIV          8
+#define EMA_SLOW_DIV          64
+#define EMA_MARGIN_DIV        4
+#define EMA_WARMUP            60
+
+// Cole-Kripke weights for epochs -4 to +2 around the scored one. Counts
+// here are zero-crossings rather than activity counts, so the scale is set
+// per night: an epoch scores awake when its weighted activity is
+// CK_WAKE_PERCENT of the window mean. The newest scored epoch is two
+// minutes old, since it needs the two after it.
+#define CK_EPOCHS             7
+#define CK_WEIGHT_SUM         4035
+#define CK_WAKE_PERCENT       125
+#define CK_MIN_SLEEP          10
+#define CK_WARMUP             30
+
+static const detector *current = NULL;
+static uint32_t window_total = 0;
+
+// Scores are how close the detector is to calling a peak, as a percentage
+// of the level it needs
+static uint16_t percent_of(uint64_t value, uint64_t level) {
+  if (level == 0)
+    return 0;
+  uint64_t percent = value * 100 / level;
+  return percent > UINT16_MAX ? UINT16_MAX : (uint16_t)percent;
+}
+
+// Bin totals, newest first
+
+static uint16_t bin_totals[PEAK_BINS];
+
+static void bins_reset(void) {
+  memset(bin_totals, 0, sizeof(bin_totals));
+}
+
+// Epochs sitting on a bin edge move into the next bin
+static void bins_push(const epoch_ring *er, uint8_t epoch) {
+  size_t n = er_size(er);
+  for (unsigned int b = 0; b < PEAK_BINS; b++) {
+    size_t edge = (b + 1) * g_params.bin_minutes - 1;
+    if (edge >= n)
+      break;
+    uint8_t moved = er_peek(er, edge);
+    bin_totals[b] -= moved;
+    if (b + 1 < PEAK_BINS)
+      bin_totals[b + 1] += moved;
+  }
+  bin_totals[0] += epoch;
+}
+
+// The mean bin over the window, blended with the wearer's usual bin. The
+// baseline keeps ten epoch bins, so the blend is scaled to ours.
+static uint16_t bins_level(const epoch_ring *er) {
+  uint32_t usual = baseline_blend(detector_mean(er) * BASELINE_BIN_EPOCHS,
+                                  er_size(er));
+  return usual * g_params.bin_minutes / BASELINE_BIN_EPOCHS;
+}
+
+static bool bins_is_peak(const epoch_ring *er) {
+  if (er_size(er) < er->capacity) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Number of samples requested is too high");
+    return false;
+  }
+  if (er->capacity / g_params.bin_minutes < PEAK_BINS) {
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Number of samples requested is too low");
+    return false;
+  }
+
+  // Mean over whole datastore, steadied by the usual level
+  uint16_t avg = bins_level(er);
+
+  // Middle bin should be above threshold
+  if (bin_totals[1] <= avg)
+    return false;
+
+  // Slope must be negative
+  if (bin_totals[0] > bin_totals[1])
+    return false;
+
+  // Previous slope must be positive
+  if (bin_totals[1] < bin_totals[2])
+    return false;
+
+  return true;
+}
+
+// The middle bin against the mean
+static uint16_t bins_score(const epoch_ring *er) {
+  return percent_of(bin_totals[1], bins_level(er));
+}
+
+// Exponential moving averages
+
+static int32_t ema_fast;
+static int32_t ema_slow;
+static uint16_t ema_epochs;
+static bool ema_rising;
+static bool ema_peak;
+
+static void ema_reset(void) {
+  ema_fast = 0;
+  ema_slow = 0;
+  ema_epochs = 0;
+  ema_rising = false;
+  ema_peak = false;
+}
+
+static void ema_push(const epoch_ring *er, uint8_t epoch) {
+  int32_t x = (int32_t)epoch << 8;
+  ema_peak = false;
+  if (ema_epochs == 0) {
+    ema_fast = x;
+    ema_slow = x;
+  } else {
+    int32_t last = ema_fast;
+    ema_fast += (x - ema_fast) / EMA_FAST_DIV;
+    ema_slow += (x - ema_slow) / EMA_SLOW_DIV;
+
+    // Flat stretches keep the direction they had
+    if (ema_fast != last) {
+      bool rising = ema_fast > last;
+      ema_peak = ema_rising && !rising && ema_epochs >= EMA_WARMUP &&
+                 last > ema_slow + ema_slow / EMA_MARGIN_DIV;
+      ema_rising = rising;
+    }
+  }
+  if (ema_epochs < UINT16_MAX)
+    ema_epochs++;
+}
+
+static bool ema_is_peak(const epoch_ring *er) {
+  return ema_peak;
+}
+
+// The fast average against the margin over the slow one
+static uint16_t ema_score(const epoch_ring *er) {
+  if (ema_fast <= 0)
+    return 0;
+  return percent_of(ema_fast, ema_slow + ema_slow / EMA_MARGIN_DIV);
+}
+
+// Cole-Kripke score
+
+static const uint16_t ck_weights[CK_EPOCHS] = {
+  404, 598, 326, 441, 1408, 508, 350
+};
+static uint16_t ck_sleep_run;
+static bool ck_peak;
+static uint16_t ck_score_percent;
+
+static void ck_reset(void) {
+  ck_sleep_run = 0;
+  ck_peak = false;
+  ck_score_percent = 0;
+}
+
+// Score the epoch two back from the new one, which is not in the ring yet.
+// Peaks last for a whole awake stretch that follows at least CK_MIN_SLEEP
+// epochs asleep.
+static void ck_push(const epoch_ring *er, uint8_t epoch) {
+  size_t n = er_size(er);
+  if (n < CK_EPOCHS - 1)
+    return;
+  uint32_t score = ck_weights[CK_EPOCHS - 1] * epoch;
+  for (unsigned int i = 0; i < CK_EPOCHS - 1; i++)
+    score += ck_weights[CK_EPOCHS - 2 - i] * er_peek(er, i);
+
+  // The window total already counts the new epoch
+  uint32_t num = n < er->capacity ? n + 1 : n;
+  uint64_t level = (uint64_t)window_total * CK_WEIGHT_SUM * CK_WAKE_PERCENT;
+  bool awake = (uint64_t)score * num * 100 >= level;
+  ck_score_percent = percent_of((uint64_t)score * num * 100, level);
+  if (!awake) {
+    ck_peak = false;
+    if (ck_sleep_run < UINT16_MAX)
+      ck_sleep_run++;
+  } else {
+    if (ck_sleep_run > 0)
+      ck_peak = ck_sleep_run >= CK_MIN_SLEEP && num >= CK_WARMUP;
+    ck_sleep_run = 0;
+  }
+}
+
+static bool ck_is_peak(const epoch_ring *er) {
+  return ck_peak;
+}
+
+// The newest scored epoch against the awake level
+static uint16_t ck_score(const epoch_ring *er) {
+  return ck_score_percent;
+}
+
+static const detector detectors[DETECTOR_COUNT] = {
+  [DETECTOR_BINS] = { "bins", bins_reset, bins_push, bins_is_peak, bins_score },
+  [DETECTOR_EMA] = { "ema", ema_reset, ema_push, ema_is_peak, ema_score },
+  [DETECTOR_COLE_KRIPKE] = { "cole-kripke", ck_reset, ck_push, ck_is_peak, ck_score },
+};
+
+// Start a detector on an empty ring
+void detector_init(DetectorType type) {
+  if (type >= DETECTOR_COUNT) {
+    APP_LOG(APP_LOG_LEVEL_ERROR, "Unknown detector %d", (int)type);
+    type = DEFAULT_DETECTOR;
+  }
+  current = &detectors[type];
+  window_total = 0;
+  current->reset();
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Detector %s", current->name);
+}
+
+DetectorType detector_type(void) {
+  return current ? (DetectorType)(current - detectors) : DEFAULT_DETECTOR;
+}
+
+const char *detector_name(void) {
+  return current ? current->name : detectors[DEFAULT_DETECTOR].name;
+}
+
+// Feed an epoch before it goes into the ring. The oldest epoch drops out
+// of the window total once the ring is full.
+void detector_push(const epoch_ring *er, uint8_t epoch) {
+  size_t n = er_size(er);
+  if (n == er->capacity)
+    window_total -= er_peek(er, n - 1);
+  window_total += epoch;
+  current->push(er, epoch);
+}
+
+// Start over on a ring that already holds epochs, after the detector or
+// the window changed. Each epoch is fed in again from the oldest, through
+// a view of the ring that writes it back where it already is.
+void detector_rebuild(epoch_ring *er) {
+  epoch_ring view = *er;
+  view.count = 0;
+  view.head = (er->head - er->count) & er->mask;
+  window_total = 0;
+  current->reset();
+  for (size_t age = er_size(er); age > 0; age--) {
+    uint8_t epoch = er_peek(er, age - 1);
+    detector_push(&view, epoch);
+    er_push_back(&view, epoch);
+  }
+}
+
+// Whether the newest epochs are a good time to wake
+bool detector_is_peak(const epoch_ring *er) {
+  return current->is_peak(er);
+}
+
+uint16_t detector_score(const epoch_ring *er) {
+  return current->score(er);
+}
+
+uint16_t detector_mean(const epoch_ring *er) {
+  uint32_t n = er_size(er);
+  if (n == 0)
+    return 0;
+  return (uint16_t)(window_total / n);
+}
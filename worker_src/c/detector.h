@@ -0,0 +1,38 @@
+#pragma once
+#include <pebble_worker.h>
+#include "datastore.h"
+
+// Streaming sleep-phase detectors. Each one sees every epoch exactly once,
+// just before it is added to the ring, and does a fixed amount of work per
+// epoch; the ring is only read for single epochs at known offsets. When
+// the settings change mid-night, detector_rebuild starts the detector over
+// on the epochs already in the ring.
+
+typedef enum {
+  DETECTOR_BINS,          // three bins, middle one a peak
+  DETECTOR_EMA,           // fast moving average turning over above the slow one
+  DETECTOR_COLE_KRIPKE,   // weighted epoch score crossing from sleep to wake
+  DETECTOR_COUNT,
+} DetectorType;
+
+// Picked when the settings don't name one
+#ifndef DEFAULT_DETECTOR
+#define DEFAULT_DETECTOR      DETECTOR_BINS
+#endif
+
+typedef struct detector {
+  const char *name;
+  void (*reset)(void);
+  void (*push)(const epoch_ring *er, uint8_t epoch);
+  bool (*is_peak)(const epoch_ring *er);
+  uint16_t (*score)(const epoch_ring *er);  // percent of the peak threshold
+} detector;
+
+void detector_init(DetectorType type);
+DetectorType detector_type(void);
+const char *detector_name(void);
+void detector_push(const epoch_ring *er, uint8_t epoch);
+void detector_rebuild(epoch_ring *er);
+bool detector_is_peak(const epoch_ring *er);
+uint16_t detector_score(const epoch_ring *er);
+uint16_t detector_mean(const epoch_ring *er);
@@ -0,0 +1,263 @@
+#include <pebble_worker.h>
+#include "history.h"
+
+#define HISTORY_FLUSH_EPOCHS    30
+#define HISTORY_RESUME_SECONDS  (15 * SECONDS_PER_MINUTE)
+
+#define NO_TOKEN                -1
+
+#define BLOCK_KEY(slot, block)  HISTORY_BLOCK_KEY(slot, block)
+
+// The encoding is described in shared/store.h. Runs and raw groups are
+// grown in place in the block until they are full, the block is, or the
+// worker restarts.
+
+static history_index s_index;
+static history_night *night = NULL;
+static uint8_t block[HISTORY_BLOCK_SIZE];
+static uint8_t block_used = 0;
+static int8_t open_token = NO_TOKEN;  // run or raw group that can still grow
+static bool raw_repeat = false;       // its last raw byte repeated the one before
+static uint8_t epochs_since_flush = 0;
+
+static void load_index(void) {
+  if (persist_read_data(HISTORY_INDEX_KEY, &s_index, sizeof(s_index)) != 
+      sizeof(s_index) || s_index.version != HISTORY_VERSION) {
+    memset(&s_index, 0, sizeof(s_index));
+    s_index.version = HISTORY_VERSION;
+  }
+}
+
+static void save_index(void) {
+  persist_write_data(HISTORY_INDEX_KEY, &s_index, sizeof(s_index));
+}
+
+static void write_block(void) {
+  persist_write_data(BLOCK_KEY(s_index.newest, s_index.last_block[s_index.newest]), 
+                     block, block_used);
+}
+
+// The night filled its blocks; what is written stays, nothing more is
+// added. Cannot happen within HISTORY_MAX_EPOCHS.
+static void close_full_night(void) {
+  APP_LOG(APP_LOG_LEVEL_WARNING, "Night history full");
+  night->open = 0;
+  save_index();
+  night = NULL;
+}
+
+// Make room for len more bytes in the block, moving on to the next one
+// if needed. A token can't carry on into a new block. The index goes out
+// with the full block, as in a flush, so a worker killed before the next
+// flush resumes in the new block with counts that match what is written.
+static bool reserve(uint8_t len) {
+  if (block_used + len <= HISTORY_BLOCK_SIZE)
+    return true;
+  write_block();
+  if (s_index.last_block[s_index.newest] + 1 >= HISTORY_BLOCKS) {
+    close_full_night();
+    return false;
+  }
+  s_index.last_block[s_index.newest]++;
+  save_index();
+  epochs_since_flush = 0;
+  block_used = 0;
+  open_token = NO_TOKEN;
+  return true;
+}
+
+static void put(uint8_t byte) {
+  block[block_used++] = byte;
+  night->num_bytes++;
+}
+
+// Start a token, leaving it open for more epochs if it can take them
+static void start_token(uint8_t token) {
+  raw_repeat = false;
+  open_token = (token & HISTORY_TOKEN_RUN) ? block_used : NO_TOKEN;
+  put(token);
+}
+
+static uint8_t open_kind(void) {
+  return open_token == NO_TOKEN ? 0 : block[open_token] & HISTORY_TOKEN_KIND;
+}
+
+static uint8_t open_count(void) {
+  return (block[open_token] & HISTORY_TOKEN_COUNT) + 1;
+}
+
+// A repeat extends an open run. Inside a raw group it is kept raw, unless
+// it is the second repeat in a row: then the first comes back out of the
+// group and the two start a run, so a group never costs more than the
+// bytes it holds plus its header.
+static bool append_repeat(uint8_t epoch) {
+  uint8_t kind = open_kind();
+  if (kind == HISTORY_TOKEN_RUN && open_count() < HISTORY_TOKEN_MAX) {
+    block[open_token]++;
+    return true;
+  }
+  if (kind == HISTORY_TOKEN_RAW && raw_repeat) {
+    block[open_token]--;
+    block_used--;
+    night->num_bytes--;
+    start_token(HISTORY_TOKEN_RUN | 1);
+    return true;
+  }
+  if (kind == HISTORY_TOKEN_RAW && open_count() < HISTORY_TOKEN_MAX) {
+    if (!reserve(1))
+      return false;
+    if (open_token != NO_TOKEN) {
+      block[open_token]++;
+      put(epoch);
+      raw_repeat = true;
+      return true;
+    }
+  }
+  if (!reserve(1))
+    return false;
+  start_token(HISTORY_TOKEN_RUN);
+  return true;
+}
+
+// A change goes into an open raw group, or as a one byte delta, or starts
+// a raw group if it is too big for that
+static bool append_change(uint8_t epoch) {
+  raw_repeat = false;
+  if (open_kind() == HISTORY_TOKEN_RAW && open_count() < HISTORY_TOKEN_MAX) {
+    if (!reserve(1))
+      return false;
+    if (open_token != NO_TOKEN) {
+      block[open_token]++;
+      put(epoch);
+      return true;
+    }
+  }
+  int16_t delta = (int16_t)epoch - night->last_value;
+  if (delta >= -64 && delta <= 63) {
+    if (!reserve(1))
+      return false;
+    start_token(delta < 0 ? ((-delta) << 1) - 1 : delta << 1);
+    return true;
+  }
+  if (!reserve(2))
+    return false;
+  start_token(HISTORY_TOKEN_RAW);
+  put(epoch);
+  return true;
+}
+
+// Start a new night, or carry on with the newest one if it was recorded
+// until just now
+void history_begin(time_t now) {
+  load_index();
+  open_token = NO_TOKEN;
+  raw_repeat = false;
+  epochs_since_flush = 0;
+  
+  history_night *newest = &s_index.nights[s_index.newest];
+  if (s_index.num_nights > 0 && newest->open && 
+      now - (newest->start_time + newest->num_epochs * SECONDS_PER_MINUTE) <= 
+      HISTORY_RESUME_SECONDS) {
+    night = newest;
+    int n = persist_read_data(BLOCK_KEY(s_index.newest, s_index.last_block[s_index.newest]), 
+                              block, sizeof(block));
+    block_used = n > 0 ? n : 0;
+    APP_LOG(APP_LOG_LEVEL_DEBUG, "Resuming night history");
+    return;
+  }
+  
+  // Take the next slot, evicting the oldest night once all are used. An
+  // empty night is simply reused.
+  newest->open = 0;
+  if (s_index.num_nights == 0) {
+    s_index.num_nights = 1;
+  } else if (newest->num_epochs > 0) {
+    s_index.newest = (s_index.newest + 1) % HISTORY_NIGHTS;
+    if (s_index.num_nights < HISTORY_NIGHTS)
+      s_index.num_nights++;
+    else
+      for (uint8_t b = 0; b <= s_index.last_block[s_index.newest]; b++)
+        persist_delete(BLOCK_KEY(s_index.newest, b));
+  }
+  
+  night = &s_index.nights[s_index.newest];
+  memset(night, 0, sizeof(*night));
+  night->start_time = now;
+  night->open = 1;
+  s_index.last_block[s_index.newest] = 0;
+  block_used = 0;
+  save_index();
+}
+
+void history_append(uint8_t epoch) {
+  if (night == NULL)
+    return;
+  bool ok = epoch == night->last_value ? append_repeat(epoch) : append_change(epoch);
+  if (!ok)
+    return;
+  night->num_epochs++;
+  night->last_value = epoch;
+  if (++epochs_since_flush >= HISTORY_FLUSH_EPOCHS)
+    history_flush();
+}
+
+// Write out the partial block, so a killed worker loses little
+void history_flush(void) {
+  if (night == NULL)
+    return;
+  write_block();
+  save_index();
+  epochs_since_flush = 0;
+}
+
+void history_finish(void) {
+  if (night == NULL)
+    return;
+  write_block();
+  night->open = 0;
+  save_index();
+  APP_LOG(APP_LOG_LEVEL_INFO, "Night history %u epochs in %u B (raw %u B)",
+          night->num_epochs, night->num_bytes, night->num_epochs);
+  night = NULL;
+}
+
+uint8_t history_num_nights(void) {
+  if (night == NULL)
+    load_index();
+  return s_index.num_nights;
+}
+
+static int slot_for_age(uint8_t age) {
+  if (night == NULL)
+    load_index();
+  if (age >= s_index.num_nights)
+    return -1;
+  return (s_index.newest + HISTORY_NIGHTS - age) % HISTORY_NIGHTS;
+}
+
+// Night by age, 0 being the newest
+bool history_get_night(uint8_t age, history_night *out) {
+  int slot = slot_for_age(age);
+  if (slot < 0)
+    return false;
+  *out = s_index.nights[slot];
+  return true;
+}
+
+// Stream a night's epochs, oldest first. Returns the number decoded.
+uint16_t history_decode(uint8_t age, HistoryEpochHandler handler, void *context) {
+  int slot = slot_for_age(age);
+  if (slot < 0)
+    return 0;
+  history_night *n = &s_index.nights[slot];
+  uint8_t data[HISTORY_BLOCK_SIZE];
+  uint16_t decoded = 0;
+  uint8_t value = 0;
+  for (uint8_t b = 0; b <= s_index.last_block[slot] && decoded < n->num_epochs; b++) {
+    int size = persist_read_data(BLOCK_KEY(slot, b), data, sizeof(data));
+    if (size > 0)
+      decoded += history_decode_bytes(data, size, n->num_epochs - decoded, &value,
+                                      handler, context);
+  }
+  return decoded;
+}
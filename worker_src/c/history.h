@@ -0,0 +1,17 @@
+#pragma once
+#include <pebble_worker.h>
+#include "store.h"
+
+// Bounded history of the last few nights of epoch counts in persist 
+// storage. Counts are delta coded, with runs of repeats collapsed and
+// restless stretches kept as raw bytes, so a night never takes much more
+// than a byte per epoch. The layout is in shared/store.h.
+
+void history_begin(time_t now);
+void history_append(uint8_t epoch);
+void history_flush(void);
+void history_finish(void);
+
+uint8_t history_num_nights(void);
+bool history_get_night(uint8_t age, history_night *night);
+uint16_t history_decode(uint8_t age, HistoryEpochHandler handler, void *context);
@@ -0,0 +1,49 @@
+#include <pebble_worker.h>
+#include "kernel.h"
+
+// Sign of one axis after removing the gravity vector, v - 1000*v/|a|,
+// compared in squared magnitudes so no square root is needed. Residuals
+// smaller than 1 mg count as zero, like the int16 truncation of the old
+// float path.
+static inline int8_t axis_sign(int16_t v, uint32_t mag_sq) {
+  uint32_t a = v < 0 ? -v : v;
+  if (a == 0 || mag_sq == ONE_G_SQ)
+    return 0;
+  uint64_t lhs = (uint64_t)ONE_G_SQ * (a * a);
+  if (mag_sq > ONE_G_SQ) {
+    if (a == 1 || (uint64_t)mag_sq * ((a - 1) * (a - 1)) < lhs)
+      return 0;
+    return v < 0 ? -1 : 1;
+  } else {
+    if ((uint64_t)mag_sq * ((a + 1) * (a + 1)) > lhs)
+      return 0;
+    return v < 0 ? 1 : -1;
+  }
+}
+
+// Count crossings on any axis between consecutive samples, skipping those
+// taken while the watch vibrated. This is the reference for the other
+// kernels.
+uint16_t kernel_count_portable(const AccelData *data, uint32_t num_samples,
+                               uint16_t *counted) {
+  uint16_t count = 0;
+  int8_t sx, sy, sz, sx_prev = 0, sy_prev = 0, sz_prev = 0;
+  const AccelData *dx = data;
+  for (uint32_t i = 0; i < num_samples; i++, dx++) {
+    if (dx->did_vibrate)
+      continue;
+    (*counted)++;
+    uint32_t mag_sq = (uint32_t)(dx->x*dx->x) + (uint32_t)(dx->y*dx->y) +
+                      (uint32_t)(dx->z*dx->z);
+    sx = axis_sign(dx->x, mag_sq);
+    sy = axis_sign(dx->y, mag_sq);
+    sz = axis_sign(dx->z, mag_sq);
+    if (sx * sx_prev < 0 || sy * sy_prev < 0 || sz * sz_prev < 0) {
+      count++;
+    }
+    sx_prev = sx;
+    sy_prev = sy;
+    sz_prev = sz;
+  }
+  return count;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <pebble_worker.h>
+
+// Zero-crossing kernels over one batch of accelerometer samples. Every
+// variant gives exactly the same counts as the portable one; which one
+// accel.c uses is fixed at build time.
+//
+// KERNEL_DSP selects the Cortex-M4 variant, using the dual 16-bit
+// multiply-accumulate. The wscript sets it for every platform but aplite,
+// which is a Cortex-M3. The host build sets it too, with the instructions
+// done in C.
+
+// Squared magnitude of 1 g in mg
+#define ONE_G_SQ              1000000UL
+
+uint16_t kernel_count_portable(const AccelData *data, uint32_t num_samples,
+                               uint16_t *counted);
+#ifdef KERNEL_DSP
+uint16_t kernel_count_dsp(const AccelData *data, uint32_t num_samples,
+                          uint16_t *counted);
+#define kernel_count          kernel_count_dsp
+#else
+#define kernel_count          kernel_count_portable
+#endif
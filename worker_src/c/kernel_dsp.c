@@ -0,0 +1,95 @@
+#include <pebble_worker.h>
+#include "kernel.h"
+
+#ifdef KERNEL_DSP
+
+// Signs of the three axes packed as bits: x, y, z positive in bits 0-2,
+// negative in bits 4-6. Two samples cross when one's positive bits meet
+// the other's negative bits.
+#define SIGNS_POSITIVE(axis)  (1 << (axis))
+#define SIGNS_NEGATIVE(axis)  (0x10 << (axis))
+#define SIGNS_SWAP(s)         ((uint8_t)(((s) << 4) | ((s) >> 4)))
+
+// acc plus both signed 16-bit halves of a times those of b
+#ifdef __arm__
+static inline int32_t smlad(uint32_t a, uint32_t b, int32_t acc) {
+  int32_t result;
+  __asm__ ("smlad %0, %1, %2, %3" : "=r" (result) : "r" (a), "r" (b), "r" (acc));
+  return result;
+}
+#else
+static inline int32_t smlad(uint32_t a, uint32_t b, int32_t acc) {
+  return (int32_t)((uint32_t)acc +
+                   (uint32_t)((int32_t)(int16_t)a * (int16_t)b) +
+                   (uint32_t)((int32_t)(int16_t)(a >> 16) * (int16_t)(b >> 16)));
+}
+#endif
+
+// Sign of v - 1000*v/|A| as in the portable kernel, rearranged around the
+// excess |A|^2 - 1 g^2 so one threshold test serves all three axes and
+// the usual small values fit a 32-bit multiply:
+//   heavier than 1 g:  (a - 1)^2 * excess >= 1e6 * (2a - 1)
+//   lighter than 1 g:  (a + 1)^2 * excess >= 1e6 * (2a + 1)
+static inline uint8_t axis_signs(int16_t v, uint32_t excess, bool heavy,
+                                 unsigned int axis) {
+  uint32_t a = v < 0 ? -v : v;
+  if (a == 0)
+    return 0;
+  uint32_t b = heavy ? a - 1 : a + 1;
+  uint32_t units = heavy ? 2 * a - 1 : 2 * a + 1;
+  bool nonzero;
+  if (b < 256 && excess < 65536)
+    nonzero = b * b * excess >= (uint32_t)ONE_G_SQ * units;
+  else
+    nonzero = (uint64_t)(b * b) * excess >= (uint64_t)ONE_G_SQ * units;
+  if (!nonzero)
+    return 0;
+  return (v < 0) == heavy ? SIGNS_NEGATIVE(axis) : SIGNS_POSITIVE(axis);
+}
+
+static inline uint8_t sample_signs(const AccelData *d) {
+  uint32_t xy;
+  memcpy(&xy, &d->x, sizeof(xy));
+  uint32_t mag_sq = (uint32_t)smlad(xy, xy, (int32_t)d->z * d->z);
+  if (mag_sq == ONE_G_SQ)
+    return 0;
+  bool heavy = mag_sq > ONE_G_SQ;
+  uint32_t excess = heavy ? mag_sq - ONE_G_SQ : ONE_G_SQ - mag_sq;
+  return axis_signs(d->x, excess, heavy, 0) |
+         axis_signs(d->y, excess, heavy, 1) |
+         axis_signs(d->z, excess, heavy, 2);
+}
+
+// Two samples per iteration, falling back to one at a time around samples
+// taken while the watch vibrated
+uint16_t kernel_count_dsp(const AccelData *data, uint32_t num_samples,
+                          uint16_t *counted) {
+  uint16_t count = 0;
+  uint16_t valid = 0;
+  uint8_t prev = 0;
+  uint32_t i = 0;
+  while (i < num_samples) {
+    const AccelData *d = &data[i];
+    if (i + 1 < num_samples && !d[0].did_vibrate && !d[1].did_vibrate) {
+      uint8_t s0 = sample_signs(&d[0]);
+      uint8_t s1 = sample_signs(&d[1]);
+      count += (s0 & SIGNS_SWAP(prev)) != 0;
+      count += (s1 & SIGNS_SWAP(s0)) != 0;
+      prev = s1;
+      valid += 2;
+      i += 2;
+      continue;
+    }
+    if (!d->did_vibrate) {
+      uint8_t s = sample_signs(d);
+      count += (s & SIGNS_SWAP(prev)) != 0;
+      prev = s;
+      valid++;
+    }
+    i++;
+  }
+  *counted += valid;
+  return count;
+}
+
+#endif
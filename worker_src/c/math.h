@@ -1,8 +0,0 @@
-#pragma once
-
-float sm_sqrt(const float);
-float sm_exp(float);
-float sm_ln(float);
-float sm_agm(float, float);
-float sm_powint(float, int);
-float sm_pow(float, float);
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include <pebble_worker.h>
+#include "params.h"
+#include "arena.h"
+#include "cycle.h"
+
+// Bounds on what the settings page may ask for. The accelerometer service
+// delivers at most 25 samples per callback, the ring holds at most
+// EPOCHS_IN_BUFFER, the cycle estimator needs the window to reach back
+// past its longest lag, and the bins detector needs three bins in it.
+#define MIN_BATCH_SAMPLES     5
+#define MAX_BATCH_SAMPLES     25
+#define MIN_BIN_MINUTES       5
+#define MAX_BIN_MINUTES       20
+#define MIN_BUFFER_MINUTES    120
+#define MIN_PRE_RECORDING     30
+#define MIN_BINS_IN_BUFFER    3
+
+_Static_assert(MIN_BUFFER_MINUTES > CYCLE_MAX_LAG, "window too short for the cycle estimator");
+
+recording_params g_params;
+
+// Read the parameter block, keeping the defaults for anything missing or
+// out of range
+void params_load(void) {
+  recording_params params;
+  g_params = PARAMS_DEFAULTS;
+  if (persist_read_data(PARAMS_KEY, &params, sizeof(params)) != sizeof(params) ||
+      params.version != PARAMS_VERSION)
+    return;
+  if (params.sample_rate == 10 || params.sample_rate == 25 ||
+      params.sample_rate == 50)
+    g_params.sample_rate = params.sample_rate;
+  if (params.batch_samples >= MIN_BATCH_SAMPLES &&
+      params.batch_samples <= MAX_BATCH_SAMPLES)
+    g_params.batch_samples = params.batch_samples;
+  if (params.buffer_minutes >= MIN_BUFFER_MINUTES &&
+      params.buffer_minutes <= EPOCHS_IN_BUFFER)
+    g_params.buffer_minutes = params.buffer_minutes;
+  if (params.bin_minutes >= MIN_BIN_MINUTES &&
+      params.bin_minutes <= MAX_BIN_MINUTES &&
+      params.bin_minutes * MIN_BINS_IN_BUFFER <= g_params.buffer_minutes)
+    g_params.bin_minutes = params.bin_minutes;
+  if (params.pre_recording_minutes >= MIN_PRE_RECORDING &&
+      params.pre_recording_minutes <= PARAMS_MAX_PRE_RECORDING)
+    g_params.pre_recording_minutes = params.pre_recording_minutes;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "Params %u Hz x%u, %u min window, %u min bins, %u min pre",
+          g_params.sample_rate, g_params.batch_samples, g_params.buffer_minutes,
+          g_params.bin_minutes, g_params.pre_recording_minutes);
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <pebble_worker.h>
+#include "store.h"
+
+// Recording parameters from the settings page on the phone, written by the
+// app (src/c/params.c) and laid out in shared/store.h. The worker reads
+// them when it starts and again on PROTOCOL_PARAMS, and takes them
+// up without stopping; a value out of range falls back to its default.
+//
+// Epochs stay one minute long whatever is set here: history, Health
+// backfill and the cycle estimator all count in minutes.
+
+extern recording_params g_params;
+
+void params_load(void);
@@ -0,0 +1,12 @@
+#include <pebble_worker.h>
+#include "protocol.h"
+
+void protocol_send(ProtocolCommand command, uint8_t seq, uint16_t data1,
+                   uint16_t data2) {
+  AppWorkerMessage message = {
+    .data0 = (uint16_t)(seq << 8) | command,
+    .data1 = data1,
+    .data2 = data2,
+  };
+  app_worker_send_message(PROTOCOL_SENDER_WORKER, &message);
+}
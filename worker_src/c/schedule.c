@@ -0,0 +1,74 @@
+#include <pebble_worker.h>
+#include "schedule.h"
+
+static alarm_slot s_slots[ALARM_SLOTS];
+static schedule_table s_table;
+static uint8_t s_cursor;          // next entry to fire
+static time_t s_found;            // when the cursor was last found
+static uint16_t s_weeks;          // weeks on from then the cursor is in
+
+// Read the app's alarm slots. Before the app has written any, the old 
+// single alarm rings every day with the default window.
+bool schedule_load(void) {
+  if (persist_read_data(ALARMS_KEY, s_slots, sizeof(s_slots)) != sizeof(s_slots)) {
+    memset(s_slots, 0, sizeof(s_slots));
+    if (persist_exists(ALARM_HOUR_KEY) && persist_exists(ALARM_MINUTE_KEY)) {
+      s_slots[0] = (alarm_slot) {
+        .hour = persist_read_int(ALARM_HOUR_KEY),
+        .minute = persist_read_int(ALARM_MINUTE_KEY),
+        .days = ALARM_EVERY_DAY,
+        .window_minutes = DEFAULT_WINDOW_MINUTES,
+      };
+    }
+  }
+  schedule_compile(s_slots, &s_table);
+  return s_table.num_entries > 0;
+}
+
+// Take one changed slot straight from the app, without going to flash
+bool schedule_set_slot(uint8_t slot, const alarm_slot *alarm) {
+  if (slot < ALARM_SLOTS)
+    s_slots[slot] = *alarm;
+  schedule_compile(s_slots, &s_table);
+  return s_table.num_entries > 0;
+}
+
+// Point the cursor at the first alarm at or after now
+void schedule_find(time_t now) {
+  struct tm *t = localtime(&now);
+  int32_t into_week = t->tm_wday * SECONDS_PER_DAY + t->tm_hour * SECONDS_PER_HOUR +
+                      t->tm_min * SECONDS_PER_MINUTE + t->tm_sec;
+  s_found = now;
+  s_weeks = 0;
+  uint8_t lo = 0;
+  uint8_t hi = s_table.num_entries;
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    if ((int32_t)s_table.entries[mid].minute_of_week * SECONDS_PER_MINUTE < into_week)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  s_cursor = lo;
+  if (s_cursor == s_table.num_entries) {
+    s_cursor = 0;
+    s_weeks++;
+  }
+}
+
+// Step to the alarm after the current one
+void schedule_advance(void) {
+  if (++s_cursor >= s_table.num_entries) {
+    s_cursor = 0;
+    s_weeks++;
+  }
+}
+
+time_t schedule_fire_time(void) {
+  return schedule_entry_time(s_found, s_table.entries[s_cursor].minute_of_week, s_weeks);
+}
+
+// Wake window of the current alarm, in seconds
+uint16_t schedule_window(void) {
+  return s_table.entries[s_cursor].window_minutes * SECONDS_PER_MINUTE;
+}
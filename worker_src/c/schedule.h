@@ -0,0 +1,14 @@
+#pragma once
+#include <pebble_worker.h>
+#include "store.h"
+
+// The week's alarms, compiled from the app's alarm slots (src/c/settings.c)
+// into a table sorted by minute of the week; the layouts are in
+// shared/store.h. Walking to the next alarm is one step along the table.
+
+bool schedule_load(void);
+bool schedule_set_slot(uint8_t slot, const alarm_slot *alarm);
+void schedule_find(time_t now);
+void schedule_advance(void);
+time_t schedule_fire_time(void);
+uint16_t schedule_window(void);
@@ -0,0 +1,27 @@
+#include <pebble_worker.h>
+#include "stats.h"
+
+worker_stats g_stats;
+
+// Start counting a night, or carry on with the saved counters if the
+// worker was restarted partway through one
+void stats_begin(time_t now, bool resume) {
+  if (resume &&
+      persist_read_data(STATS_KEY, &g_stats, sizeof(g_stats)) == sizeof(g_stats) &&
+      g_stats.version == STATS_VERSION && g_stats.open)
+    return;
+  memset(&g_stats, 0, sizeof(g_stats));
+  g_stats.version = STATS_VERSION;
+  g_stats.open = true;
+  g_stats.start_time = now;
+}
+
+void stats_save(bool open) {
+  g_stats.open = open;
+  persist_write_data(STATS_KEY, &g_stats, sizeof(g_stats));
+}
+
+void stats_fired(bool peak, uint16_t ring_fill) {
+  g_stats.fire = peak ? STATS_FIRE_PEAK : STATS_FIRE_FALLBACK;
+  g_stats.ring_fill = ring_fill;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <pebble_worker.h>
+#include "params.h"
+#include "store.h"
+
+// Always-on counters for the worker's hot paths, kept for the current
+// night and written to persist storage when recording stops. The app
+// shows them in its diagnostics window (src/c/diagnostics.c); the layout
+// is in shared/store.h.
+
+extern worker_stats g_stats;
+
+void stats_begin(time_t now, bool resume);
+void stats_save(bool open);
+void stats_fired(bool peak, uint16_t ring_fill);
+
+typedef struct stats_timer {
+  time_t seconds;
+  uint16_t ms;
+} stats_timer;
+
+static inline void stats_timer_start(stats_timer *timer) {
+  time_ms(&timer->seconds, &timer->ms);
+}
+
+static inline uint32_t stats_timer_ms(const stats_timer *timer) {
+  time_t seconds;
+  uint16_t ms;
+  time_ms(&seconds, &ms);
+  return (uint32_t)(seconds - timer->seconds) * 1000 + ms - timer->ms;
+}